@@ -0,0 +1,145 @@
+/**
+ * @file bench_codec.c
+ * @author Federico Turco ()
+ * @brief Microbenchmark CRC16 e codec ModBus TCP <-> RTU
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "../src/crc.h"
+#include "../src/modbus.h"
+
+#define ITERATIONS      2000000
+
+// Evita che il compilatore elimini i loop
+static volatile uint64_t sink;
+
+static uint64_t nanos(void)
+{
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+
+    return (uint64_t)spec.tv_sec * 1000000000 + (uint64_t)spec.tv_nsec;
+}
+
+static void report(const char *name, uint64_t start, uint64_t end, long iterations)
+{
+    double ns = (double)(end - start) / iterations;
+
+    printf("%-28s %10.1f ns/op %14.0f ops/s\n", name, ns, 1.0e9 / ns);
+}
+
+int main(int argc, char *argv[])
+{
+    long iterations = argc > 1 ? atol(argv[1]) : ITERATIONS;
+
+    // FC03, 10 registri e FC16, 123 registri (frame massimo)
+    uint8_t tcpRead[]  = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A };
+    uint8_t tcpWrite[MB_TCP_ADU_MAX];
+    uint8_t rtu[MB_RTU_ADU_MAX];
+    uint8_t tcp[MB_TCP_ADU_MAX];
+    mbap_header mbap;
+    uint64_t start;
+
+    memset(tcpWrite, 0x55, sizeof(tcpWrite));
+    tcpWrite[0] = 0x00; tcpWrite[1] = 0x02; tcpWrite[2] = 0x00; tcpWrite[3] = 0x00;
+    tcpWrite[4] = 0x00; tcpWrite[5] = 0xFD; tcpWrite[6] = 0x01; tcpWrite[7] = 0x10;
+    tcpWrite[8] = 0x00; tcpWrite[9] = 0x00; tcpWrite[10] = 0x00; tcpWrite[11] = 0x7B; tcpWrite[12] = 0xF6;
+
+    ssize_t writeLen = tcpWrite[5] + 6;
+
+    printf("Iterations: %li\n\n", iterations);
+
+    // CRC16 su frame corto e frame massimo
+    start = nanos();
+    for(long i = 0; i < iterations; i++){
+        sink += addCrc16(rtu, 8);
+    }
+    report("addCrc16 (8 bytes)", start, nanos(), iterations);
+
+    start = nanos();
+    for(long i = 0; i < iterations; i++){
+        sink += addCrc16(rtu, MB_RTU_ADU_MAX - 2);
+    }
+    report("addCrc16 (254 bytes)", start, nanos(), iterations);
+
+    ssize_t rtuLen = addCrc16(rtu, MB_RTU_ADU_MAX - 2);
+
+    start = nanos();
+    for(long i = 0; i < iterations; i++){
+        sink += checkCrc16(rtu, rtuLen);
+    }
+    report("checkCrc16 (256 bytes)", start, nanos(), iterations);
+
+    // Parsing MBAP e previsione lunghezza risposta
+    start = nanos();
+    for(long i = 0; i < iterations; i++){
+        sink += mbParseMbap(tcpRead, sizeof(tcpRead), &mbap);
+    }
+    report("mbParseMbap", start, nanos(), iterations);
+
+    start = nanos();
+    for(long i = 0; i < iterations; i++){
+        sink += mbValidatePdu(&tcpRead[7], sizeof(tcpRead) - 7);
+    }
+    report("mbValidatePdu", start, nanos(), iterations);
+
+    start = nanos();
+    for(long i = 0; i < iterations; i++){
+        sink += mbResponseLen(&tcpRead[7], sizeof(tcpRead) - 7);
+    }
+    report("mbResponseLen", start, nanos(), iterations);
+
+    start = nanos();
+    for(long i = 0; i < iterations; i++){
+        sink += mbBuildException(&mbap, 0x03, MB_EX_SLAVE_DEVICE_BUSY, tcp, sizeof(tcp));
+    }
+    report("mbBuildException", start, nanos(), iterations);
+
+    // Traduzione TCP -> RTU -> TCP
+    start = nanos();
+    for(long i = 0; i < iterations; i++){
+        sink += mbBuildRtu(tcpRead, sizeof(tcpRead), rtu, sizeof(rtu));
+    }
+    report("mbBuildRtu (FC03 read)", start, nanos(), iterations);
+
+    start = nanos();
+    for(long i = 0; i < iterations; i++){
+        sink += mbBuildRtu(tcpWrite, writeLen, rtu, sizeof(rtu));
+    }
+    report("mbBuildRtu (FC16 max)", start, nanos(), iterations);
+
+    rtuLen = mbBuildRtu(tcpWrite, writeLen, rtu, sizeof(rtu));
+
+    start = nanos();
+    for(long i = 0; i < iterations; i++){
+        sink += mbBuildTcp(&mbap, rtu, rtuLen, tcp, sizeof(tcp));
+    }
+    report("mbBuildTcp (max)", start, nanos(), iterations);
+
+    // Frame completo: parse, previsione, RTU con CRC, verifica CRC, TCP
+    start = nanos();
+    for(long i = 0; i < iterations; i++){
+        ssize_t len = mbParseMbap(tcpRead, sizeof(tcpRead), &mbap);
+        sink += mbValidatePdu(&tcpRead[7], len - 7);
+        sink += mbResponseLen(&tcpRead[7], len - 7);
+        len = mbBuildRtu(tcpRead, len, rtu, sizeof(rtu));
+        sink += checkCrc16(rtu, len);
+        sink += mbBuildTcp(&mbap, rtu, len, tcp, sizeof(tcp));
+    }
+    report("full frame (FC03 read)", start, nanos(), iterations);
+
+    printf("\n");
+
+    return EXIT_SUCCESS;
+}
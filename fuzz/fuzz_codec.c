@@ -0,0 +1,120 @@
+/**
+ * @file fuzz_codec.c
+ * @author Federico Turco ()
+ * @brief Harness libFuzzer / AFL per CRC16 e codec ModBus TCP <-> RTU, request TCP e risposte RTU
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "../src/crc.h"
+#include "../src/modbus.h"
+
+// Qualsiasi violazione degli invarianti viene segnalata come crash
+#define FUZZ_ASSERT(cond)   do { if(!(cond)) abort(); } while(0)
+
+// Risposta RTU dallo slave: byte arbitrari dalla seriale, come li tratta il gateway
+static void fuzzRtuResponse(const uint8_t *data, size_t size)
+{
+    uint8_t rtu[MB_RTU_ADU_MAX];
+    uint8_t tcp[MB_TCP_ADU_MAX];
+    mbap_header mbap = { .transactionId = 0x1234, .unitId = 1 };
+
+    // Stessa dimensione del buffer di ricezione seriale
+    if(size > MB_RTU_ADU_MAX)
+        size = MB_RTU_ADU_MAX;
+
+    memcpy(rtu, data, size);
+
+    // Lunghezza attesa dopo ogni byte ricevuto: mai oltre quella prevista
+    for(size_t i = 0; i <= size; i++){
+        ssize_t expected = mbRtuExpectedLen(rtu, i, MB_RTU_ADU_MAX);
+
+        FUZZ_ASSERT(expected == MB_RTU_ADU_MAX || expected == MB_RTU_EXCEPTION_LEN);
+    }
+
+    // Frame con CRC non valido: scartato, altrimenti convertito in TCP
+    if(checkCrc16(rtu, size) == 0){
+        ssize_t tcpLen = mbBuildTcp(&mbap, rtu, size, tcp, sizeof(tcp));
+
+        FUZZ_ASSERT(tcpLen == -1 || (tcpLen == (ssize_t)size + 4 && memcmp(&tcp[6], rtu, size - 2) == 0));
+    }
+
+    // Stessi byte con CRC corretto, per superare il controllo
+    if(size > MB_RTU_ADU_MAX - 2)
+        size = MB_RTU_ADU_MAX - 2;
+
+    ssize_t rtuLen = addCrc16(rtu, size);
+
+    FUZZ_ASSERT(rtuLen < 4 || checkCrc16(rtu, rtuLen) == 0);
+
+    ssize_t tcpLen = mbBuildTcp(&mbap, rtu, rtuLen, tcp, sizeof(tcp));
+
+    FUZZ_ASSERT(rtuLen < 4 ? tcpLen == -1 : tcpLen == rtuLen + 4);
+
+    if(tcpLen > 0){
+        FUZZ_ASSERT(tcp[0] == 0x12 && tcp[1] == 0x34 && tcp[2] == 0 && tcp[3] == 0);
+        FUZZ_ASSERT(((tcp[4] << 8) + tcp[5]) == tcpLen - 6);
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    uint8_t tcp[MB_TCP_ADU_MAX];
+    uint8_t rtu[MB_RTU_ADU_MAX];
+    uint8_t back[MB_TCP_ADU_MAX];
+    mbap_header mbap;
+
+    fuzzRtuResponse(data, size);
+
+    // Stessa dimensione del buffer di lettura del gateway
+    if(size > MB_TCP_ADU_MAX)
+        size = MB_TCP_ADU_MAX;
+
+    memcpy(tcp, data, size);
+
+    // CRC su input arbitrario (anche troppo corto)
+    checkCrc16(tcp, size);
+
+    ssize_t frameLen = mbParseMbap(tcp, size, &mbap);
+
+    if(frameLen == -1)
+        return 0;
+
+    FUZZ_ASSERT(frameLen >= MB_MBAP_LEN + 1 && frameLen <= (ssize_t)size);
+
+    uint8_t exCode = mbValidatePdu(&tcp[7], frameLen - 7);
+    ssize_t responseLen = mbResponseLen(&tcp[7], frameLen - 7);
+
+    FUZZ_ASSERT(responseLen == -1 || (responseLen >= 4 && responseLen <= MB_RTU_ADU_MAX));
+
+    // Una request valida ha sempre una lunghezza di risposta prevedibile
+    FUZZ_ASSERT(exCode != 0 || responseLen != -1);
+
+    if(exCode){
+        ssize_t exLen = mbBuildException(&mbap, tcp[7], exCode, back, sizeof(back));
+
+        FUZZ_ASSERT(exLen == MB_TCP_EXCEPTION_LEN && back[7] == (tcp[7] | 0x80) && back[8] == exCode);
+    }
+
+    // TCP -> RTU: il CRC appena calcolato deve essere valido
+    ssize_t rtuLen = mbBuildRtu(tcp, frameLen, rtu, sizeof(rtu));
+
+    FUZZ_ASSERT(rtuLen == frameLen - 6 + 2);
+    FUZZ_ASSERT(rtuLen < 4 || checkCrc16(rtu, rtuLen) == 0);
+
+    // RTU -> TCP: deve restituire lo stesso frame della request
+    ssize_t tcpLen = mbBuildTcp(&mbap, rtu, rtuLen, back, sizeof(back));
+
+    FUZZ_ASSERT(tcpLen == frameLen);
+    FUZZ_ASSERT(memcmp(back, tcp, tcpLen) == 0);
+
+    return 0;
+}
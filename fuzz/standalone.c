@@ -0,0 +1,62 @@
+/**
+ * @file standalone.c
+ * @author Federico Turco ()
+ * @brief Driver per eseguire gli harness di fuzzing senza libFuzzer (gcc + sanitizer)
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+// Uso: standalone [file ...]  -> esegue i file del corpus e poi input casuali derivati
+int main(int argc, char *argv[])
+{
+    uint8_t data[512];
+    size_t size;
+    long iterations = 1000000;
+
+    srand(1);
+
+    for(int i = 1; i < argc; i++){
+        FILE *file_ = fopen(argv[i], "rb");
+
+        if(file_ == NULL){
+            perror(argv[i]);
+            continue;
+        }
+
+        size = fread(data, 1, sizeof(data), file_);
+        fclose(file_);
+
+        LLVMFuzzerTestOneInput(data, size);
+    }
+
+    // Input casuali con header MBAP plausibile, per raggiungere il codec oltre il parsing
+    for(long n = 0; n < iterations; n++){
+        size = rand() % sizeof(data);
+
+        for(size_t i = 0; i < size; i++)
+            data[i] = rand();
+
+        if(size > 6 && (n & 1)){
+            data[2] = 0;
+            data[3] = 0;
+            data[4] = 0;
+            data[5] = (size - 6) & 0xFF;
+        }
+
+        LLVMFuzzerTestOneInput(data, size);
+    }
+
+    fprintf(stderr, "%li inputs executed\n", iterations + argc - 1);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file busload.c
+ * @author Federico Turco ()
+ * @brief Stima del tempo di bus e controllo di ammissione
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <termios.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "busload.h"
+
+// Tempo di bus stimato (us) per intervallo della finestra
+typedef struct{
+    uint64_t epoch;         // Numero dell'intervallo (millis / durata intervallo)
+    uint64_t busyUs;
+} busload_slot;
+
+static busload_slot window[MAX_RTU_BUS][BUSLOAD_SLOTS];
+
+// Tempo di bus stimato delle transazioni ammesse e non ancora concluse (us)
+static uint64_t pendingUs[MAX_RTU_BUS];
+
+// Finestre e pending sono aggiornati dai thread di accept e dai thread dei bus
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Durata di un intervallo della finestra in ms
+static uint64_t slotMillis(const rtu_head *rtu)
+{
+    uint64_t ms = rtu->busWindow / BUSLOAD_SLOTS;
+
+    return ms ? ms : 1;
+}
+
+// Tempo di un carattere in us: start, dati, parita', stop
+uint32_t busCharTime(const rtu_head *rtu)
+{
+    uint32_t bits = 1 + (rtu->configuration[0] == '7' ? 7 : 8);
+
+    if(rtu->configuration[1] != 'N' && rtu->configuration[1] != 'n')
+        bits++;
+
+    bits += rtu->configuration[2] == '2' ? 2 : 1;
+
+    return (bits * 1000000 + rtu->baud - 1) / rtu->baud;
+}
+
+// Silenzio di 3.5 caratteri, fisso a 1750 us oltre 19200 baud
+uint32_t busGapTime(const rtu_head *rtu)
+{
+    return rtu->baud > 19200 ? 1750 : (busCharTime(rtu) * 7) / 2;
+}
+
+// Tempo di bus di una transazione: request, turnaround, risposta e silenzio dopo ogni frame
+uint32_t busWireTime(const rtu_head *rtu, ssize_t reqLen, ssize_t respLen)
+{
+    uint32_t gapUs = rtu->interframeUs >= 0 ? (uint32_t)rtu->interframeUs : busGapTime(rtu);
+
+    return (reqLen + respLen) * busCharTime(rtu) + rtu->turnaroundUs + 2 * gapUs;
+}
+
+static void busLoadAdd(int bus, const rtu_head *rtu, uint32_t wireUs)
+{
+    uint64_t epoch = millis() / slotMillis(rtu);
+    busload_slot *slot = &window[bus][epoch % BUSLOAD_SLOTS];
+
+    if(slot->epoch != epoch){
+        slot->epoch = epoch;
+        slot->busyUs = 0;
+    }
+
+    slot->busyUs += wireUs;
+}
+
+static uint32_t busLoadUtilLocked(int bus, const rtu_head *rtu)
+{
+    uint64_t slotMs = slotMillis(rtu);
+    uint64_t epoch = millis() / slotMs;
+    uint64_t busyUs = 0;
+
+    for(int i = 0; i < BUSLOAD_SLOTS; i++){
+        busload_slot *slot = &window[bus][i];
+
+        if(slot->epoch + BUSLOAD_SLOTS > epoch)
+            busyUs += slot->busyUs;
+    }
+
+    return (busyUs / 10) / (slotMs * BUSLOAD_SLOTS);
+}
+
+// Utilizzo del bus in percentuale sulla finestra scorrevole
+uint32_t busLoadUtil(int bus, const rtu_head *rtu)
+{
+    pthread_mutex_lock(&lock);
+    uint32_t util = busLoadUtilLocked(bus, rtu);
+    pthread_mutex_unlock(&lock);
+
+    return util;
+}
+
+// 1 se la transazione puo' essere accettata: utilizzo sotto soglia e attesa stimata
+// (eta' della request + transazioni gia' in coda) entro il budget.
+// Le request ad alta priorita' sono sempre accettate. Se accettata il tempo di bus viene contabilizzato
+int busAdmit(int bus, const rtu_head *rtu, uint32_t wireUs, uint64_t ageMs, int priority)
+{
+    int admit = 1;
+
+    pthread_mutex_lock(&lock);
+
+    if(!priority){
+        if(rtu->busUtilMax && busLoadUtilLocked(bus, rtu) >= (uint32_t)rtu->busUtilMax)
+            admit = 0;
+
+        if(rtu->busQueueBudget && ageMs + (pendingUs[bus] + wireUs) / 1000 > (uint64_t)rtu->busQueueBudget)
+            admit = 0;
+    }
+
+    if(admit){
+        busLoadAdd(bus, rtu, wireUs);
+        pendingUs[bus] += wireUs;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return admit;
+}
+
+// Transazione ammessa conclusa (eseguita, scartata o rifiutata dalla coda)
+void busLoadDone(int bus, uint32_t wireUs)
+{
+    pthread_mutex_lock(&lock);
+    pendingUs[bus] = pendingUs[bus] > wireUs ? pendingUs[bus] - wireUs : 0;
+    pthread_mutex_unlock(&lock);
+}
+
+void busLoadDump(FILE *out, config *config)
+{
+    fprintf(out, "\nBus load (window)\n");
+
+    for(int i = 0; i < config->nBus; i++){
+        rtu_head *rtu = &config->rtu[i];
+
+        if(rtu->device[0] == 0)
+            continue;
+
+        fprintf(out, "  bus %i %-20s %3u%% of %li ms, max %i%%, char %u us, pending %llu us\n",
+                i + 1, rtu->device, busLoadUtil(i, rtu), rtu->busWindow, rtu->busUtilMax, busCharTime(rtu),
+                (unsigned long long)pendingUs[i]);
+    }
+
+    fflush(out);
+}
@@ -0,0 +1,33 @@
+/**
+ * @file busload.h
+ * @author Federico Turco ()
+ * @brief Stima del tempo di bus e controllo di ammissione
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#ifndef BUSLOAD_H
+#define BUSLOAD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <termios.h>
+
+#include "config.h"
+
+// Numero di intervalli della finestra scorrevole
+#define BUSLOAD_SLOTS   10
+
+uint32_t busCharTime(const rtu_head *rtu);
+uint32_t busGapTime(const rtu_head *rtu);
+uint32_t busWireTime(const rtu_head *rtu, ssize_t reqLen, ssize_t respLen);
+uint32_t busLoadUtil(int bus, const rtu_head *rtu);
+int busAdmit(int bus, const rtu_head *rtu, uint32_t wireUs, uint64_t ageMs, int priority);
+void busLoadDone(int bus, uint32_t wireUs);
+void busLoadDump(FILE *out, config *config);
+
+#endif
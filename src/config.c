@@ -15,11 +15,13 @@
 #include <stdlib.h>
 #include <time.h>
 #include <errno.h>
+#include <pthread.h>
 
 // Socket
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -28,6 +30,30 @@
 #include <termios.h>
 
 #include "config.h"
+#include "serial.h"
+#include "busload.h"
+
+// Baudrate con costante termios, gli altri vengono impostati con termios2
+static const struct{
+    int baud;
+    speed_t speed;
+} baudrates[] = {
+    { 1200,    B1200 },
+    { 2400,    B2400 },
+    { 4800,    B4800 },
+    { 9600,    B9600 },
+    { 19200,   B19200 },
+    { 38400,   B38400 },
+    { 57600,   B57600 },
+    { 115200,  B115200 },
+    { 230400,  B230400 },
+    { 460800,  B460800 },
+    { 921600,  B921600 },
+};
+
+// Snapshot corrente della configurazione
+static pthread_mutex_t snapshotLock = PTHREAD_MUTEX_INITIALIZER;
+static config *snapshot = NULL;
 
 
 void printMillis(void)
@@ -44,40 +70,84 @@ void printMillis(void)
     printf(".%3lu] ", millis);
 }
 
+// Clock monotonico: non risente di NTP o cambi d'orario (solo per timeout e latenze)
 uint64_t millis(void)
 {
     struct timespec spec;
-    clock_gettime(CLOCK_REALTIME, &spec);
+    clock_gettime(CLOCK_MONOTONIC, &spec);
 
     uint64_t millis = (uint64_t)(spec.tv_sec) * 1.0e3 + (uint64_t)(spec.tv_nsec) / 1.0e6;
     return millis;
 }
 
-void readConfig(config *config)
+int readConfig(config *config, const char *path)
 {
     char line[256];
     int linenum=0;
+    int currBus = 0;
+    int routeDefault = 1;
 
     // Apro il file di configurazione
-    FILE *file_ = fopen("/etc/gwModbus/gwModbus.ini", "r");
+    FILE *file_ = fopen(path, "r");
+
+    if(file_ == NULL){
+        printMillis();
+        printf("ERROR: Cannot open configuration file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
     
     // Default values
-    config->rtu.tty_VTIME = 1;
-    config->rtu.tty_VMIN = 0;
+    memset(config->rtu, 0, sizeof(config->rtu));
+    memset(config->route, 0, sizeof(config->route));
+    config->nClient = 0;
+    config->tcp.backlog = 128;
+    config->tcp.acceptors = 1;
+    config->tcp.keepalive = 10;
+    config->shmName[0] = 0;
+    config->rt.enable = 0;
+    config->rt.priority = 50;
+    config->rt.cpu = -1;
+
+    for(int i = 0; i < MAX_RTU_BUS; i++){
+        config->rtu[i].tty_VTIME = 1;
+        config->rtu[i].tty_VMIN = 0;
+        config->rtu[i].busWindow = 1000;
+        config->rtu[i].interframeUs = -1;
+        config->rtu[i].turnaroundUs = 0;
+    }
 
     printMillis();
-    printf("Reading configuration file\n");
+    printf("Reading configuration file %s\n", path);
 
     while(fgets(line, 256, file_) != NULL)
     {
             char key[256], sep[10], value[256];
 
             linenum++;
-            if(line[0] == '#' || line[0] == '[') 
+            if(line[0] == '#') 
                 continue;
 
+            // Sezione: [TCP_RTU_n] o [RTU_n] seleziona il bus n
+            if(line[0] == '['){
+                int n;
+
+                if(sscanf(line, "[TCP_RTU_%d]", &n) == 1 || sscanf(line, "[RTU_%d]", &n) == 1){
+                    if(n < 1 || n > MAX_RTU_BUS){
+                        printMillis();
+                        printf("ERROR: Invalid bus number %i at line %i (max %i)\n", n, linenum, MAX_RTU_BUS);
+                        fclose(file_);
+                        return -1;
+                    }
+
+                    currBus = n - 1;
+                }
+                continue;
+            }
+
             if(sscanf(line, "%s %s %s", key, sep, value) == 3)
             {
+                rtu_head *rtu = &config->rtu[currBus];
+
                 // Verbose
                 if(strcmp(key, "verbose") == 0){
 
@@ -116,13 +186,40 @@ void readConfig(config *config)
                     config->tcp.timeout = atol(value);
                 }
 
+                // Backlog
+                if(strcmp(key, "tcp_backlog") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key tcp_backlog\n");
+
+                    config->tcp.backlog = atoi(value);
+                }
+
+                // Thread di accept
+                if(strcmp(key, "tcp_acceptors") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key tcp_acceptors\n");
+
+                    config->tcp.acceptors = atoi(value);
+                }
+
+                // Keepalive
+                if(strcmp(key, "tcp_keepalive") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key tcp_keepalive\n");
+
+                    config->tcp.keepalive = atoi(value);
+                }
+
                 // Device
                 if(strcmp(key, "ser_device") == 0){
 
                     if(config->verbose > 2)
                     printf("Found key ser_device\n");
 
-                    memcpy(&config->rtu.device, &value, sizeof(config->rtu.device));
+                    memcpy(&rtu->device, &value, sizeof(rtu->device));
                 }
 
                 // Baudrate
@@ -131,7 +228,7 @@ void readConfig(config *config)
                     if(config->verbose > 2)
                     printf("Found key ser_baud\n");
 
-                    config->rtu.baud = atoi(value);
+                    rtu->baud = atoi(value);
                 }
 
                 // Configuration
@@ -140,7 +237,7 @@ void readConfig(config *config)
                     if(config->verbose > 2)
                     printf("Found key ser_configuration\n");
 
-                    memcpy(&config->rtu.configuration, &value, sizeof(config->rtu.configuration));
+                    memcpy(&rtu->configuration, &value, sizeof(rtu->configuration));
                 }
 
                 // Timeout
@@ -149,7 +246,7 @@ void readConfig(config *config)
                     if(config->verbose > 2)
                     printf("Found key ser_timeout\n");
 
-                    config->rtu.timeout = atol(value);
+                    rtu->timeout = atol(value);
                 }
 
                 // tty_VTIME
@@ -158,7 +255,7 @@ void readConfig(config *config)
                     if(config->verbose > 2)
                     printf("Found key tty_VTIME\n");
 
-                    config->rtu.tty_VTIME = atoi(value);
+                    rtu->tty_VTIME = atoi(value);
                 }
 
                 // tty_VMIN
@@ -167,7 +264,157 @@ void readConfig(config *config)
                     if(config->verbose > 2)
                     printf("Found key tty_VMIN\n");
 
-                    config->rtu.tty_VMIN = atoi(value);
+                    rtu->tty_VMIN = atoi(value);
+                }
+
+                // Real-time
+                if(strcmp(key, "rt_enable") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key rt_enable\n");
+
+                    config->rt.enable = atoi(value);
+                }
+
+                if(strcmp(key, "rt_priority") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key rt_priority\n");
+
+                    config->rt.priority = atoi(value);
+                }
+
+                if(strcmp(key, "rt_cpu") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key rt_cpu\n");
+
+                    config->rt.cpu = atoi(value);
+                }
+
+                // Memoria condivisa immagine registri
+                if(strcmp(key, "shm_name") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key shm_name\n");
+
+                    snprintf(config->shmName, sizeof(config->shmName), "%s", value);
+                }
+
+                // Silenzio minimo tra due frame
+                if(strcmp(key, "ser_interframe_us") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key ser_interframe_us\n");
+
+                    rtu->interframeUs = atol(value);
+                }
+
+                // Attesa tra fine trasmissione e ricezione
+                if(strcmp(key, "ser_turnaround_us") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key ser_turnaround_us\n");
+
+                    rtu->turnaroundUs = atol(value);
+                }
+
+                // Finestra utilizzo bus
+                if(strcmp(key, "bus_window") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key bus_window\n");
+
+                    rtu->busWindow = atol(value);
+                }
+
+                // Soglia utilizzo bus
+                if(strcmp(key, "bus_util_max") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key bus_util_max\n");
+
+                    rtu->busUtilMax = atoi(value);
+                }
+
+                // Budget attesa in coda
+                if(strcmp(key, "bus_queue_budget") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key bus_queue_budget\n");
+
+                    rtu->busQueueBudget = atol(value);
+                }
+
+                // Route di default per gli unit ID non elencati (0 = scarta)
+                if(strcmp(key, "route_default") == 0){
+
+                    if(config->verbose > 2)
+                    printf("Found key route_default\n");
+
+                    routeDefault = atoi(value);
+                }
+
+                // Route: unit ID TCP, bus, slave ID RTU, [offset indirizzo]
+                if(strcmp(key, "route") == 0){
+                    int unit, bus, slave, offset = 0;
+
+                    if(config->verbose > 2)
+                    printf("Found key route\n");
+
+                    if(sscanf(line, "%*s %*s %d %d %d %d", &unit, &bus, &slave, &offset) < 3 ||
+                       unit < 0 || unit > 255 || slave < 0 || slave > 255 || bus < 1 || bus > MAX_RTU_BUS ||
+                       offset < -65535 || offset > 65535){
+                        printMillis();
+                        printf("ERROR: Invalid route at line %i\n", linenum);
+                        fclose(file_);
+                        return -1;
+                    }
+
+                    config->route[unit].enabled = 1;
+                    config->route[unit].bus = bus - 1;
+                    config->route[unit].unit = slave;
+                    config->route[unit].offset = offset;
+                }
+
+                // Client: indirizzo IP, deadline request in ms, [priorita'], [half-close]
+                if(strcmp(key, "client") == 0){
+                    long deadline;
+                    int priority = 0;
+                    int halfClose = 0;
+
+                    if(config->verbose > 2)
+                    printf("Found key client\n");
+
+                    if(config->nClient >= MAX_CLIENT_RULES || sscanf(line, "%*s %*s %*s %ld %d %d", &deadline, &priority, &halfClose) < 1 || deadline < 0){
+                        printMillis();
+                        printf("ERROR: Invalid client at line %i (max %i clients)\n", linenum, MAX_CLIENT_RULES);
+                        fclose(file_);
+                        return -1;
+                    }
+
+                    // Indirizzo in forma binaria: confronto indipendente dalla scrittura (es. 2001:0db8::1)
+                    client_rule *client = &config->client[config->nClient];
+                    struct in_addr v4;
+
+                    if(inet_pton(AF_INET6, value, &client->address) != 1){
+                        if(inet_pton(AF_INET, value, &v4) != 1){
+                            printMillis();
+                            printf("ERROR: Invalid client address %s at line %i\n", value, linenum);
+                            fclose(file_);
+                            return -1;
+                        }
+
+                        memset(&client->address, 0, sizeof(client->address));
+                        client->address.s6_addr[10] = 0xFF;
+                        client->address.s6_addr[11] = 0xFF;
+                        memcpy(&client->address.s6_addr[12], &v4, sizeof(v4));
+                    }
+
+                    config->nClient++;
+                    client->deadline = deadline;
+                    client->priority = priority;
+                    client->halfClose = halfClose;
                 }
 
             if(config->verbose){
@@ -190,17 +437,85 @@ void readConfig(config *config)
     printf("\n");
 
     fclose(file_);
+
+    if(config->tcp.acceptors < 1 || config->tcp.acceptors > MAX_ACCEPTORS){
+        printMillis();
+        printf("ERROR: tcp_acceptors must be between 1 and %i\n", MAX_ACCEPTORS);
+        return -1;
+    }
+
+    // Numero di bus configurati
+    config->nBus = 0;
+
+    for(int i = 0; i < MAX_RTU_BUS; i++){
+        if(config->rtu[i].device[0] != 0){
+            config->nBus = i + 1;
+
+            // Silenzio di default: t3.5 dal tempo carattere reale
+            if(config->rtu[i].interframeUs < 0 && config->rtu[i].baud > 0)
+                config->rtu[i].interframeUs = busGapTime(&config->rtu[i]);
+        }
+    }
+
+    if(routeDefault < 0 || routeDefault > config->nBus){
+        printMillis();
+        printf("ERROR: route_default refers to bus %i, not configured\n", routeDefault);
+        return -1;
+    }
+
+    // Completo la tabella: gli unit ID non elencati vanno 1:1 sul bus di default
+    for(int i = 0; i < 256; i++){
+        route_entry *route = &config->route[i];
+
+        if(route->enabled){
+            if(route->bus >= config->nBus || config->rtu[route->bus].device[0] == 0){
+                printMillis();
+                printf("ERROR: Route for unit ID %i refers to bus %i, not configured\n", i, route->bus + 1);
+                return -1;
+            }
+        }
+        else if(routeDefault){
+            route->enabled = 1;
+            route->bus = routeDefault - 1;
+            route->unit = i;
+            route->offset = 0;
+        }
+    }
+
+    return 0;
 }
 
-int configureSerial(config *config, struct termios *p_tty)
+int configureSerial(config *config, int bus, struct termios *p_tty)
 {
+    rtu_head *rtu = &config->rtu[bus];
+
+    // Apro seriale
+    int serialPort = open(rtu->device, O_RDWR);
+
+    if(serialPort == -1){
+        printMillis();
+        printf("Error %i opening %s: %s\n", errno, rtu->device, strerror(errno));
+
+        return -1;
+    }
+
+    if(applySerial(config, bus, serialPort, p_tty) == -1){
+        close(serialPort);
+        return -1;
+    }
+
+    return serialPort;
+}
+
+// Applico i parametri del bus alla seriale gia' aperta, 0 se ok
+int applySerial(config *config, int bus, int serialPort, struct termios *p_tty)
+{
+    rtu_head *rtu = &config->rtu[bus];
+
     if(config->verbose){
         printMillis();
-        printf("Serial configuration:\n\n");
+        printf("Serial configuration bus %i (%s):\n\n", bus + 1, rtu->device);
     }
-    
-    // Apro seriale
-    int serialPort = open(config->rtu.device, O_RDWR);
 
     // Leggo configurazione esistente e eventuali errori
     if(tcgetattr(serialPort, p_tty) != 0) {
@@ -208,11 +523,11 @@ int configureSerial(config *config, struct termios *p_tty)
         printMillis();
         printf("Error %i from tcgetattr: %s\n", errno, strerror(errno));
         
-        exit(EXIT_FAILURE);
+        return -1;
     }
 
     // Parity
-    if(config->rtu.configuration[1] == 'N' || config->rtu.configuration[1] == 'n')
+    if(rtu->configuration[1] == 'N' || rtu->configuration[1] == 'n')
     {
         p_tty->c_cflag &= ~PARENB;         // DISABLE PARITY
 
@@ -221,7 +536,7 @@ int configureSerial(config *config, struct termios *p_tty)
             printf("Parity: No parity\n");
         }
     }
-    else if(config->rtu.configuration[1] == 'E' || config->rtu.configuration[1] == 'e')
+    else if(rtu->configuration[1] == 'E' || rtu->configuration[1] == 'e')
     {
         p_tty->c_cflag &= ~PARODD;         // DISABLE ODD PARYTY (EVEN)
         p_tty->c_cflag |= PARENB;          // ENABLE PARITY
@@ -231,7 +546,7 @@ int configureSerial(config *config, struct termios *p_tty)
             printf("Parity: Even\n");
         }
     }
-    else if(config->rtu.configuration[1] == 'O' || config->rtu.configuration[1] == 'o')
+    else if(rtu->configuration[1] == 'O' || rtu->configuration[1] == 'o')
     {
         p_tty->c_cflag |= PARODD;          // ENABLE ODD PARYTY
         p_tty->c_cflag |= PARENB;          // ENABLE PARITY
@@ -245,14 +560,39 @@ int configureSerial(config *config, struct termios *p_tty)
     {
         printMillis();
         printf("ERROR: Invalid parity selected\n");
-        exit(EXIT_FAILURE);
+        return -1;
+    }
+
+    // Stop bits
+    if(rtu->configuration[2] == '1')
+    {
+        p_tty->c_cflag &= ~CSTOPB;
+
+        if(config->verbose){
+            printMillis();
+            printf("Stop bits: 1\n");
+        }
+    }
+    else if(rtu->configuration[2] == '2')
+    {
+        p_tty->c_cflag |= CSTOPB;
+
+        if(config->verbose){
+            printMillis();
+            printf("Stop bits: 2\n");
+        }
+    }
+    else
+    {
+        printMillis();
+        printf("ERROR: Invalid stop bits\n");
+        return -1;
     }
 
-    p_tty->c_cflag &= ~CSTOPB;         // Clear stop field, only one stop bit used in communication (most common)
     p_tty->c_cflag &= ~CSIZE;          // Clear all bits that set the data size 
 
     // Bytesize
-    if(config->rtu.configuration[0] == '8')
+    if(rtu->configuration[0] == '8')
     {
         p_tty->c_cflag |= CS8;
         
@@ -261,7 +601,7 @@ int configureSerial(config *config, struct termios *p_tty)
             printf("Bytesize: 8\n");
         }
     }
-    else if(config->rtu.configuration[0] == '7')
+    else if(rtu->configuration[0] == '7')
     {
         p_tty->c_cflag |= CS7;
 
@@ -274,7 +614,7 @@ int configureSerial(config *config, struct termios *p_tty)
     {
         printMillis();
         printf("ERROR: Invalid bytesize\n");
-        exit(EXIT_FAILURE);
+        return -1;
     }
 
     // Definitions prese da https://blog.mbedded.ninja/programming/operating-systems/linux/linux-serial-ports-using-c-cpp/
@@ -296,89 +636,39 @@ int configureSerial(config *config, struct termios *p_tty)
     // VMIN > 0 and VTIME = 0 -> Pure counted read, triggers only when characters size (VMIN) is reached
     // VMIN > 0 and VTIME > 0 -> Trigger only if len > 0 with or timeout of VTIME elapsed
 
-    p_tty->c_cc[VTIME] = config->rtu.tty_VTIME;
-    p_tty->c_cc[VMIN] = config->rtu.tty_VMIN;
+    p_tty->c_cc[VTIME] = rtu->tty_VTIME;
+    p_tty->c_cc[VMIN] = rtu->tty_VMIN;
     
     if(config->verbose){
         printMillis();
-        printf("Timeout: %li\n", config->rtu.timeout);
+        printf("Timeout: %li\n", rtu->timeout);
     }
 
-    // Set baudrate
-    switch(config->rtu.baud)
-    {
-        case 4800:
-            cfsetispeed(p_tty, B4800);
-            cfsetospeed(p_tty, B4800);
-
-            if(config->verbose){
-                printMillis();
-                printf("Baudrate: 4800\n");
-            }
-            break;
-
-        case 9600:
-            cfsetispeed(p_tty, B9600);
-            cfsetospeed(p_tty, B9600);
-            
-            if(config->verbose){
-                printMillis();
-                printf("Baudrate: 9600\n");
-            }
-            break;
-
-        case 19200:
-            cfsetispeed(p_tty, B19200);
-            cfsetospeed(p_tty, B19200);
-
-            if(config->verbose){
-                printMillis();
-                printf("Baudrate: 19200\n");
-            }
-            break;
-
-        case 38400:
-            cfsetispeed(p_tty, B38400);
-            cfsetospeed(p_tty, B38400);
-            
-            if(config->verbose){
-                printMillis();
-                printf("Baudrate: 38400\n");
-            }
-            break;
+    // Set baudrate: velocita' standard con cfsetspeed, le altre con termios2 (BOTHER) dopo tcsetattr
+    speed_t speed = B0;
 
-        case 57600:
-            cfsetispeed(p_tty, B57600);
-            cfsetospeed(p_tty, B57600);
-            
-            if(config->verbose){
-                printMillis();
-                printf("Baudrate: 57600\n");
-            }
-            break;
+    for(unsigned int i = 0; i < sizeof(baudrates) / sizeof(baudrates[0]); i++){
+        if(baudrates[i].baud == rtu->baud)
+            speed = baudrates[i].speed;
+    }
 
-        case 115200:
-            cfsetispeed(p_tty, B115200);
-            cfsetospeed(p_tty, B115200);
-            
-            if(config->verbose){
-                printMillis();
-                printf("Baudrate: 115200\n");
-            }
-            break;
+    if(rtu->baud <= 0){
+        printMillis();
+        printf("ERROR: Invalid baudrate\n");
+        return -1;
+    }
 
-        default:
-            printMillis();
-            printf("ERROR: Invalid baudrate\n");
-            exit(EXIT_FAILURE);
+    if(speed != B0){
+        cfsetispeed(p_tty, speed);
+        cfsetospeed(p_tty, speed);
     }
 
     if(config->verbose){
         printf("\n");
         printMillis();
-        printf("VTIME: %i\n", config->rtu.tty_VTIME);
+        printf("VTIME: %i\n", rtu->tty_VTIME);
         printMillis();
-        printf("VMIN:  %i\n", config->rtu.tty_VMIN);
+        printf("VMIN:  %i\n", rtu->tty_VMIN);
     }
     
     // Applico tty settings
@@ -386,67 +676,229 @@ int configureSerial(config *config, struct termios *p_tty)
         printMillis();
         printf("Error %i from tcsetattr: %s\n", errno, strerror(errno));
 
-        exit(EXIT_FAILURE);
+        return -1;
+    }
+
+    if(speed == B0 && serialSetBaud(serialPort, rtu->baud) != 0){
+        printMillis();
+        printf("Error %i setting baudrate %i (termios2): %s\n", errno, rtu->baud, strerror(errno));
+
+        return -1;
+    }
+
+    if(config->verbose){
+        printMillis();
+        printf("Baudrate: %i (driver: %i)\n", rtu->baud, serialGetBaud(serialPort));
+        printMillis();
+        printf("Inter-frame: %li us, turnaround: %li us\n", rtu->interframeUs, rtu->turnaroundUs);
     }
 
     if(config->verbose)
         printf("\n");
 
-    return serialPort;
+    return 0;
 }
 
 int configureSocket(config *config)
 {
     int server_sockfd;
     int enable = 1;
-    struct sockaddr_in server_address;
+    int disable = 0;
+    char port[8];
+    struct addrinfo hints, *res;
+
+    // Indirizzo numerico IPv4 o IPv6
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
 
-    struct protoent *protoent;
-    protoent = getprotobyname("tcp");
+    snprintf(port, sizeof(port), "%i", config->tcp.port);
 
-    if (protoent == NULL) {
-        exit(EXIT_FAILURE);
+    int err = getaddrinfo(config->tcp.address[0] ? config->tcp.address : NULL, port, &hints, &res);
+
+    if (err != 0) {
+        printMillis();
+        printf("Invalid tcp_address %s: %s\n", config->tcp.address, gai_strerror(err));
+        return -1;
     }
 
-    server_sockfd = socket(AF_INET, SOCK_STREAM, protoent->p_proto);
+    server_sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
 
     // Check che la socket sia valida
     if (server_sockfd == -1) {
         perror("Socket error: ");
-        exit(EXIT_FAILURE);
+        freeaddrinfo(res);
+        return -1;
     }
 
     // Set sock option - REUSEADDR
     if (setsockopt(server_sockfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0) {
         perror("setsockopt(SO_REUSEADDR) failed");
-        exit(EXIT_FAILURE);
+        freeaddrinfo(res);
+        close(server_sockfd);
+        return -1;
     }
 
-    // Set sock option - SO_RCVTIMEO
+    // Set sock option - REUSEPORT, una socket per thread di accept bilanciate dal kernel,
+    // e nuove socket aperte dal reload mentre le precedenti sono ancora in ascolto
+    if (setsockopt(server_sockfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+        perror("setsockopt(SO_REUSEPORT) failed");
+        freeaddrinfo(res);
+        close(server_sockfd);
+        return -1;
+    }
+
+    // Set sock option - IPV6_V6ONLY disabilitato: "::" accetta anche client IPv4
+    if (res->ai_family == AF_INET6 && setsockopt(server_sockfd, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable)) < 0) {
+        perror("setsockopt(IPV6_V6ONLY) failed");
+        freeaddrinfo(res);
+        close(server_sockfd);
+        return -1;
+    }
+
+    if (bind(server_sockfd, res->ai_addr, res->ai_addrlen) == -1) 
+    {
+        perror("Bind error: ");
+        freeaddrinfo(res);
+        close(server_sockfd);
+        return -1;
+    }
+
+    freeaddrinfo(res);
+
+    if (configureListener(config, server_sockfd) == -1) {
+        close(server_sockfd);
+        return -1;
+    }
+
+    return server_sockfd;
+}
+
+// Timeout e backlog della socket in ascolto, anche gia' attiva (reload senza riaprirla). 0 se ok
+int configureListener(config *config, int server_sockfd)
+{
+    // Set sock option - SO_RCVTIMEO, ereditato dalle connessioni accettate
     struct timeval tv;
     tv.tv_sec = config->tcp.timeout / 1000;
-    tv.tv_usec = (config->tcp.timeout - (config->tcp.timeout * 1000)) * 1000;
+    tv.tv_usec = (config->tcp.timeout % 1000) * 1000;
 
     if (setsockopt(server_sockfd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv)) {
         perror("setsockopt(SO_RCVTIMEO) failed");
-        exit(EXIT_FAILURE);
+        return -1;
+    }
+
+    if (listen(server_sockfd, config->tcp.backlog) == -1) {
+        perror("Listen error: ");
+        return -1;
     }
 
-    // Definizione server
-    server_address.sin_family = AF_INET;
-    inet_aton(config->tcp.address, &server_address.sin_addr);
-    server_address.sin_port = htons(config->tcp.port);
+    return 0;
+}
 
-    if (bind(server_sockfd, (struct sockaddr*)&server_address, sizeof(server_address)) == -1) 
-    {
-        perror("Bind error: ");
-        exit(EXIT_FAILURE);
+// Opzioni delle connessioni accettate: niente Nagle, keepalive per rilevare i client spariti
+void configureClient(config *config, int client_sockfd)
+{
+    int enable = 1;
+
+    setsockopt(client_sockfd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    if(config->tcp.keepalive > 0){
+        int idle = config->tcp.keepalive;
+        int interval = idle / 3 > 0 ? idle / 3 : 1;
+        int count = 3;
+
+        setsockopt(client_sockfd, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+        setsockopt(client_sockfd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(client_sockfd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        setsockopt(client_sockfd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
     }
+}
 
-    if (listen(server_sockfd, 5) == -1) {
-        perror("Listen error: ");
-        exit(EXIT_FAILURE);
+// Impostazioni dedicate del client, NULL se non presenti. Gli IPv4 (anche ::ffff: su socket dual-stack)
+// sono confrontati in forma mappata
+client_rule *findClient(config *config, const struct sockaddr_storage *address)
+{
+    struct in6_addr addr;
+
+    if(address->ss_family == AF_INET6){
+        addr = ((const struct sockaddr_in6 *)address)->sin6_addr;
+    }else{
+        memset(&addr, 0, sizeof(addr));
+        addr.s6_addr[10] = 0xFF;
+        addr.s6_addr[11] = 0xFF;
+        memcpy(&addr.s6_addr[12], &((const struct sockaddr_in *)address)->sin_addr, 4);
     }
 
-    return server_sockfd;
+    for(int i = 0; i < config->nClient; i++){
+        if(memcmp(&config->client[i].address, &addr, sizeof(addr)) == 0)
+            return &config->client[i];
+    }
+
+    return NULL;
+}
+
+// Snapshot corrente con un riferimento in piu', da rilasciare con configRelease
+config *configAcquire(void)
+{
+    pthread_mutex_lock(&snapshotLock);
+
+    config *config = snapshot;
+    config->refs++;
+
+    pthread_mutex_unlock(&snapshotLock);
+
+    return config;
+}
+
+// Rilascio di un riferimento, lo snapshot viene liberato con l'ultimo
+void configRelease(config *config)
+{
+    pthread_mutex_lock(&snapshotLock);
+
+    int refs = --config->refs;
+
+    pthread_mutex_unlock(&snapshotLock);
+
+    if(refs == 0)
+        free(config);
+}
+
+// Nuovo snapshot (allocato con malloc, non piu' modificato) per le request successive,
+// le transazioni in corso mantengono il precedente fino al configRelease
+void configPublish(config *config)
+{
+    config->refs = 1;
+
+    pthread_mutex_lock(&snapshotLock);
+
+    struct config *old = snapshot;
+    snapshot = config;
+
+    pthread_mutex_unlock(&snapshotLock);
+
+    if(old != NULL)
+        configRelease(old);
+}
+
+// Cambiano i parametri con cui e' aperta la seriale
+int serialChanged(const rtu_head *a, const rtu_head *b)
+{
+    return strncmp(a->device, b->device, sizeof(a->device)) != 0 || a->baud != b->baud ||
+           memcmp(a->configuration, b->configuration, sizeof(a->configuration)) != 0 ||
+           a->tty_VTIME != b->tty_VTIME || a->tty_VMIN != b->tty_VMIN;
+}
+
+// Cambia l'indirizzo delle socket in ascolto: vanno riaperte
+int listenerChanged(const tcp_head *a, const tcp_head *b)
+{
+    return strncmp(a->address, b->address, sizeof(a->address)) != 0 || a->port != b->port;
+}
+
+// Cambiano timeout, backlog o numero di thread: si applicano alle socket gia' aperte
+// (tcp_keepalive e' applicato alle singole connessioni)
+int listenerTuned(const tcp_head *a, const tcp_head *b)
+{
+    return a->timeout != b->timeout || a->backlog != b->backlog || a->acceptors != b->acceptors;
 }
@@ -13,12 +13,17 @@
 #define CONFIG_H
 
 #include <termios.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
 
 // TCP
 typedef struct{
-    char address[20];
+    char address[46];   // IPv4 o IPv6, "::" = dual-stack
     int port;
     long timeout;
+    int backlog;        // Connessioni in attesa di accept per socket
+    int acceptors;      // Thread di accept, ognuno con la propria socket SO_REUSEPORT
+    int keepalive;      // s di inattivita' prima dei keepalive TCP, 0 = disabilitati
 } tcp_head;
 
 // RTU
@@ -29,22 +34,76 @@ typedef struct{
     long timeout;
     int tty_VTIME;
     int tty_VMIN;
+    long interframeUs;      // us, silenzio minimo prima di ogni request (default t3.5)
+    long turnaroundUs;      // us, attesa tra fine trasmissione e inizio ricezione
+    long busWindow;         // ms, finestra per il calcolo dell'utilizzo
+    int busUtilMax;         // %, oltre questo utilizzo le request a bassa priorita' sono rifiutate (0 = disabilitato)
+    long busQueueBudget;    // ms, attesa massima stimata prima della transazione (0 = disabilitato)
 } rtu_head;
 
-// File di configurazione
+// Real-time
+typedef struct{
+    int enable;         // mlockall, pre-allocazione, SCHED_FIFO
+    int priority;       // Priorita' SCHED_FIFO (1..99)
+    int cpu;            // CPU dedicata ai thread dei bus, -1 = nessuna
+} rt_head;
+
+// Numero massimo di thread di accept
+#define MAX_ACCEPTORS   16
+
+// Numero massimo di bus seriali gestiti
+#define MAX_RTU_BUS     4
+
+// Routing unit ID TCP -> bus / slave RTU
 typedef struct{
+    uint8_t enabled;
+    uint8_t bus;        // Indice bus (0 based)
+    uint8_t unit;       // Slave ID sul bus RTU
+    int32_t offset;     // Offset sommato all'indirizzo registro
+} route_entry;
+
+// Numero massimo di client con impostazioni dedicate
+#define MAX_CLIENT_RULES    16
+
+// Impostazioni per singolo client TCP
+typedef struct{
+    struct in6_addr address;    // Indirizzo IP del client, gli IPv4 come ::ffff:a.b.c.d
+    long deadline;      // ms, request piu' vecchie vengono scartate (0 = nessuna deadline)
+    int priority;       // 0 = bassa (soggetta al controllo di ammissione), 1 = alta
+    int halfClose;      // 1 = il client chiude in scrittura (shutdown(SHUT_WR)) e attende la risposta
+} client_rule;
+
+// File di configurazione
+typedef struct config{
     uint8_t verbose;
+    rt_head rt;
     tcp_head tcp;
-    rtu_head rtu;
+    rtu_head rtu[MAX_RTU_BUS];
+    uint8_t nBus;
+    route_entry route[256];    // Tabella densa indicizzata per unit ID
+    client_rule client[MAX_CLIENT_RULES];
+    uint8_t nClient;
+    char shmName[32];          // Segmento immagine registri, vuoto = disabilitato
+    int refs;                  // Riferimenti allo snapshot (configAcquire / configRelease)
 } config;
 
 
 
 void printMillis(void);
 uint64_t millis(void);
-void readConfig(config *config);
-int configureSerial(config *config, struct termios *tty);
+int readConfig(config *config, const char *path);
+int configureSerial(config *config, int bus, struct termios *tty);
+int applySerial(config *config, int bus, int serialPort, struct termios *tty);
 int configureSocket(config *config);
+int configureListener(config *config, int server_sockfd);
+void configureClient(config *config, int client_sockfd);
+client_rule *findClient(config *config, const struct sockaddr_storage *address);
+config *configAcquire(void);
+void configRelease(config *config);
+void configPublish(config *config);
+int serialChanged(const rtu_head *a, const rtu_head *b);
+int listenerChanged(const tcp_head *a, const tcp_head *b);
+int listenerTuned(const tcp_head *a, const tcp_head *b);
 
 
 #endif
\ No newline at end of file
@@ -10,12 +10,12 @@
  */
 
 #include <stdint.h>
-#include <stdio.h>
+#include <sys/types.h>
 
-#include "config.h"
+#include "crc.h"
 
 
-ssize_t addCrc16(uint8_t *buffer, ssize_t len){
+uint16_t crc16(const uint8_t *buffer, ssize_t len){
 
     uint16_t crc = 0xFFFF;
 
@@ -38,6 +38,13 @@ ssize_t addCrc16(uint8_t *buffer, ssize_t len){
         }
     }
 
+    return crc;
+}
+
+ssize_t addCrc16(uint8_t *buffer, ssize_t len){
+
+    uint16_t crc = crc16(buffer, len);
+
     buffer[len]     = crc & 0xFF;        // LSB
     buffer[len + 1] = crc >> 8;          // MSB
 
@@ -45,34 +52,13 @@ ssize_t addCrc16(uint8_t *buffer, ssize_t len){
     return len;
 }
 
-int8_t checkCrc16(uint8_t *buffer, ssize_t len){
+// 0 se il CRC in coda al frame e' valido (frame di almeno slave ID + FC + CRC)
+int8_t checkCrc16(const uint8_t *buffer, ssize_t len){
 
-    uint16_t crc = 0xFFFF;
+    if(len < 4)
+        return 1;
 
-    for (int16_t pos = 0; pos < (len - 2); pos++)
-    {
-        crc ^= buffer[pos];    // XOR
-
-        for (int16_t i = 8; i != 0; i--)
-        {
-            // Passo ogni byte del pacchetto
-            if ((crc & 0x0001) != 0)
-            {
-                crc >>= 1;
-                crc ^= 0xA001;
-            }
-            else
-            {             
-                crc >>= 1;
-            }
-        }
-    }
-
-    if(!(buffer[len - 2] == (crc & 0xFF) && buffer[len - 1] == (crc >> 8))){
-        printMillis();
-        printf("ERROR: Invalid CRC, read: [%2x,%2x], calc: [%2x,%2x]\n", buffer[len -2], buffer[len -1], crc & 0xFF, crc >> 8);
-    };
+    uint16_t crc = crc16(buffer, len - 2);
 
     return !(buffer[len - 2] == (crc & 0xFF) && buffer[len - 1] == (crc >> 8));
 }
-
@@ -2,7 +2,11 @@
 #ifndef CRC_H
 #define CRC_H
 
+#include <stdint.h>
+#include <sys/types.h>
+
+uint16_t crc16(const uint8_t *buffer, ssize_t len);
 ssize_t addCrc16(uint8_t *buffer, ssize_t len);
-int8_t checkCrc16(uint8_t *buffer, ssize_t len);
+int8_t checkCrc16(const uint8_t *buffer, ssize_t len);
 
 #endif
\ No newline at end of file
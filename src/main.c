@@ -30,19 +30,28 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+// pthread_attr_setaffinity_np
+#define _GNU_SOURCE
+
 // Standard libs
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
 #include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sched.h>
 
 // Socket
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <poll.h>
 #include <unistd.h>
+#include <pthread.h>
 
 // Serial
 #include <fcntl.h>
@@ -50,267 +59,1003 @@
 
 #include "config.h"
 #include "crc.h"
+#include "modbus.h"
+#include "busload.h"
+#include "queue.h"
+#include "regimage.h"
+#include "rt.h"
+#include "serial.h"
+#include "stats.h"
+#include "trace.h"
 
 // Def. buffer size
-#define BUFSIZE_MODBUS  256
-#define BUFSIZE_TCP     256
+#define BUFSIZE_MODBUS  MB_RTU_ADU_MAX
+#define BUFSIZE_TCP     MB_TCP_ADU_MAX
 
 #define version         "1.0"
 
 
 
+// Stack dei thread di accept (bloccato in memoria in modalita' real-time)
+#define ACCEPTOR_STACK  (256 * 1024)
+
+// Stack dei thread dei bus, comprende la parte pre-allocata in modalita' real-time
+#define BUS_STACK       (2 * RT_STACK_PREFAULT)
+
+#define CONFIG_FILE     "/etc/gwModbus/gwModbus.ini"
+
+// Thread di accept con la propria socket in ascolto. Allocato da openListeners, liberato dal thread
+// stesso quando esce: un thread fermato dal reload puo' restare attivo anche dopo il reload successivo
+typedef struct{
+    int socket;
+    int stop;
+} acceptor_t;
+
 // Global vars
-config settings;
-struct termios tty;
+const char *configPath = CONFIG_FILE;
+struct termios tty[MAX_RTU_BUS];
+int serialPort[MAX_RTU_BUS];
+rtu_head serialApplied[MAX_RTU_BUS]; // Parametri con cui e' configurata la seriale aperta
+uint64_t busIdleUs[MAX_RTU_BUS];     // Istante (us monotonici) da cui il bus puo' trasmettere
+
+// Un thread per bus, unico proprietario della seriale. busLock e' tenuto durante la transazione
+// e dal reload quando verifica o ripristina i parametri della seriale
+pthread_t busThread[MAX_RTU_BUS];
+int busStarted[MAX_RTU_BUS];
+pthread_mutex_t busLock[MAX_RTU_BUS] = { [0 ... MAX_RTU_BUS - 1] = PTHREAD_MUTEX_INITIALIZER };
+pthread_attr_t busAttr;
+
+// Thread di accept attivi (detached): al reload i nuovi partono prima che i vecchi vengano fermati
+acceptor_t *acceptorList[MAX_ACCEPTORS];
+int acceptorCount = 0;
+pthread_attr_t acceptorAttr;
+
+// Scrittura completa del buffer, ripresa se interrotta da un segnale
+ssize_t writeAll(int fd, const uint8_t *buf, ssize_t len, int socket){
+    ssize_t sent = 0;
+
+    while(sent < len){
+        ssize_t n = socket ? send(fd, &buf[sent], len - sent, MSG_NOSIGNAL) : write(fd, &buf[sent], len - sent);
+
+        if(n == -1 && errno == EINTR)
+            continue;
+
+        if(n <= 0)
+            return -1;
+
+        sent += n;
+    }
 
+    return sent;
+}
 
-int main(){
-    printf("\n");
-    printf("------------------------------------\n");
-    printf("------ GW Modbus TCP <-> RTU  ------\n");
-    printf("------------------------------------\n");
-    printf("\n");
-    printf("Version: %s\n", version);
-    printf("\n");
+// Invio al client una risposta di eccezione ModBus
+void sendException(config *config, int client_sockfd, mbap_header *mbap, uint8_t fc, uint8_t code){
+    uint8_t buf[MB_TCP_EXCEPTION_LEN];
+    ssize_t nBytes = mbBuildException(mbap, fc, code, buf, sizeof(buf));
 
-    // Leggo la configurazione dal file .ini
-    readConfig(&settings);
+    if(config->verbose > 1){
+        printMillis();
+        printf("-> TX TCP [%3zu]: ", nBytes);
 
-    // Configuro la seriale
-    int serialPort = configureSerial(&settings, &tty);
+        for(int i = 0; i < nBytes; i++){
+            printf("%02x ", buf[i]);
+        }
 
-    // Flush buffer input/output
-    tcflush(serialPort, TCIOFLUSH);
+        printf("(exception %02x)\n", code);
+    }
 
-    // Info
-    if(settings.verbose){
+    writeAll(client_sockfd, buf, nBytes, 1);
+    STATS_INC(exceptions);
+}
+
+// Istante (millis) di arrivo dell'ultimo dato dal client, compresa l'attesa nel backlog del kernel
+uint64_t requestArrival(int client_sockfd){
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    uint64_t now = millis();
+
+    if(getsockopt(client_sockfd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0 && info.tcpi_last_data_recv < now)
+        return now - info.tcpi_last_data_recv;
+
+    return now;
+}
+
+// Il client ha chiuso la connessione: RST, oppure FIN confermato da recv() == 0 (nessun dato in sospeso).
+// Per i client che chiudono solo in scrittura (shutdown(SHUT_WR)) e attendono la risposta conta solo il RST
+int clientGone(int client_sockfd, int halfClose){
+    struct pollfd pfd = { .fd = client_sockfd, .events = POLLRDHUP };
+    uint8_t byte;
+
+    if(poll(&pfd, 1, 0) <= 0)
+        return 0;
+
+    if(pfd.revents & (POLLHUP | POLLERR))
+        return 1;
+
+    if(!halfClose && (pfd.revents & POLLRDHUP) && recv(client_sockfd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+        return 1;
+
+    return 0;
+}
+
+// Indirizzo numerico del client, gli IPv4 su socket dual-stack senza prefisso ::ffff:
+void clientAddress(struct sockaddr_storage *address, char *name, size_t nameLen, int *port){
+    if(address->ss_family == AF_INET6){
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)address;
+
+        if(IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr))
+            inet_ntop(AF_INET, &in6->sin6_addr.s6_addr[12], name, nameLen);
+        else
+            inet_ntop(AF_INET6, &in6->sin6_addr, name, nameLen);
+
+        *port = ntohs(in6->sin6_port);
+    }else{
+        struct sockaddr_in *in = (struct sockaddr_in *)address;
+
+        inet_ntop(AF_INET, &in->sin_addr, name, nameLen);
+        *port = ntohs(in->sin_port);
+    }
+}
+
+// Lettura e validazione della request, routing e traduzione in RTU, ammissione e accodamento verso il bus.
+// Ritorna 0 se la transazione e' stata accodata, altrimenti la socket del client va chiusa
+int acceptRequest(config *config, transaction *tx, int client_sockfd, struct sockaddr_storage *client_address){
+    trace_entry *tr = &tx->tr;
+
+    // Buffer
+    uint8_t buf_0[BUFSIZE_TCP];
+    int clientPort;
+
+    ssize_t nBytes = read(client_sockfd, buf_0, BUFSIZE_TCP);
+    traceMark(tr, TRACE_TCP_RX);
+
+    tx->client_sockfd = client_sockfd;
+    tx->config = config;
+    tx->arrivalMillis = requestArrival(client_sockfd);
+
+    // Errore lettura
+    if(nBytes == -1)
+        return -1;
+
+    // Scarto pacchetti troppo corti
+    if(nBytes < 8)
+        return -1;
+
+    clientAddress(client_address, tx->clientName, sizeof(tx->clientName), &clientPort);
+
+    // Impostazioni del client risolte una volta, valgono per tutta la transazione
+    client_rule *client = findClient(config, client_address);
+
+    tx->deadline = client ? client->deadline : config->tcp.timeout;
+    tx->priority = client ? client->priority : 0;
+    tx->halfClose = client ? client->halfClose : 0;
+
+    // Info connessione in ingresso
+    if(config->verbose > 1){
+        printMillis();
+        printf("Accepted connection from %s:%i\n", tx->clientName, clientPort);
+    }
+
+    // Output console
+    if(config->verbose > 1){
+        printMillis();
+        printf("<- RX TCP [%3zu]: ", nBytes);
+
+        for(int i = 0; i < nBytes; i++){
+            printf("%02x ", buf_0[i]);
+        }
+
+        printf("\n");
+    }
+
+    // Header MBAP: protocol identifier 00 00, lunghezza coerente con i byte ricevuti
+    mbap_header *mbap = &tx->mbap;
+    ssize_t frameLen = mbParseMbap(buf_0, nBytes, mbap);
+
+    if(frameLen == -1){
         printMillis();
-        printf("Starting server at %s:%i\n", settings.tcp.address, settings.tcp.port);
+        printf("ERROR: Invalid MBAP header [%02x %02x %02x %02x %02x %02x] for [%3zu] bytes received\n", buf_0[0], buf_0[1], buf_0[2], buf_0[3], buf_0[4], buf_0[5], nBytes);
+        return -1;
     }
 
-    // Configuro socket
-    int socket = configureSocket(&settings);
+    tr->unit = mbap->unitId;
+    tr->fc = buf_0[7];
 
-    if(settings.verbose){
+    if(frameLen != nBytes){
         printMillis();
-        printf("Ok, Running\n\n");
+        printf("ERROR: incoming buffer length [%3zu] != MosBus packet length + 6 [%3zu]\n", nBytes, frameLen);
+        nBytes = frameLen;
+    }
+
+    STATS_INC(requests);
+
+    // Function code sconosciuto o request non valida
+    uint8_t exCode = mbValidatePdu(&buf_0[7], nBytes - 7);
+
+    if(exCode){
+        printMillis();
+        printf("Invalid request FC %2i, exception %02x\n", buf_0[7], exCode);
+        sendException(config, client_sockfd, mbap, buf_0[7], exCode);
+        return -1;
+    }
+
+    const mb_fc_desc *fc = mbFc(buf_0[7]);
+    tx->responseLen = mbResponseLen(&buf_0[7], nBytes - 7);
+
+    // Risposta oltre i limiti dell'ADU RTU
+    if(tx->responseLen == -1){
+        printMillis();
+        printf("Response length not predictable for FC %2i\n", buf_0[7]);
+        return -1;
+    }
+
+    // Routing: bus, slave ID e offset indirizzo dalla tabella
+    uint8_t unitId = buf_0[6];
+    route_entry *route = &config->route[unitId];
+    rtu_head *rtu = &config->rtu[route->bus];
+
+    tx->unitId = unitId;
+    tx->route = *route;
+    tr->bus = route->bus;
+
+    if(!route->enabled){
+        printMillis();
+        printf("No route for unit ID %i\n", unitId);
+        sendException(config, client_sockfd, mbap, buf_0[7], MB_EX_GATEWAY_PATH_UNAVAILABLE);
+        return -1;
+    }
+
+    // Range richiesto lato TCP, prima del remap
+    tx->startAddr = (buf_0[8] << 8) + buf_0[9];
+    tx->quantity = fc->maxQuantity && !fc->write ? (buf_0[10] << 8) + buf_0[11] : 0;
+
+    // Riscrivo unit ID e indirizzo prima di calcolare il CRC
+    buf_0[6] = route->unit;
+
+    // Es. FC08 non ha indirizzo registro (sub-function).
+    // Il range rimappato (indirizzo + quantity, FC01-04, 0F, 10) deve restare entro i 64K
+    if(route->offset != 0 && fc->hasAddress){
+        long address = ((buf_0[8] << 8) + buf_0[9]) + route->offset;
+        long quantity = fc->maxQuantity ? (buf_0[10] << 8) + buf_0[11] : 1;
+
+        if(address < 0 || address + quantity > 0x10000){
+            printMillis();
+            printf("Remapped address %li out of range for unit ID %i\n", address, unitId);
+            sendException(config, client_sockfd, mbap, buf_0[7], MB_EX_ILLEGAL_DATA_ADDRESS);
+            return -1;
+        }
+
+        buf_0[8] = address >> 8;
+        buf_0[9] = address & 0xFF;
+    }
+
+    if(config->verbose > 2 && (route->unit != unitId || route->bus != 0 || route->offset != 0)){
+        printMillis();
+        printf("Route unit ID %i -> bus %i, slave ID %i, offset %i\n", unitId, route->bus + 1, route->unit, route->offset);
+    }
+
+    // Creo un nuovo buffer con il pacchetto da inviare sulla 485 (con CRC ModBus)
+    tx->rtuLen = mbBuildRtu(buf_0, nBytes, tx->rtu, BUFSIZE_MODBUS);
+
+    // Controllo di ammissione: con bus saturo le request a bassa priorita' ricevono subito 0x06
+    tx->wireUs = busWireTime(rtu, tx->rtuLen, tx->responseLen);
+
+    if(!busAdmit(route->bus, rtu, tx->wireUs, millis() - tx->arrivalMillis, tx->priority)){
+        if(config->verbose){
+            printMillis();
+            printf("Request from %s rejected, bus %i busy (%u%%)\n", tx->clientName, route->bus + 1, busLoadUtil(route->bus, rtu));
+        }
+
+        STATS_INC(rejectBusy);
+        sendException(config, client_sockfd, mbap, buf_0[7], MB_EX_SLAVE_DEVICE_BUSY);
+        return -1;
     }
 
+    // Passo la transazione al thread del bus
+    traceMark(tr, TRACE_QUEUE_IN);
+
+    if(queuePush(route->bus, tx) == -1){
+        if(config->verbose){
+            printMillis();
+            printf("Request from %s rejected, queue full\n", tx->clientName);
+        }
+
+        busLoadDone(route->bus, tx->wireUs);
+        STATS_INC(rejectBusy);
+        sendException(config, client_sockfd, mbap, buf_0[7], MB_EX_SLAVE_DEVICE_BUSY);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Thread di accept: una socket SO_REUSEPORT per thread, il kernel distribuisce le connessioni.
+// Fermato con stop, chiude la propria socket ed esce senza che nessuno lo attenda
+void *acceptorLoop(void *arg){
+    acceptor_t *acceptor = arg;
+    struct pollfd pfd = { .fd = acceptor->socket, .events = POLLIN };
+
     while (1) {
+        int stop = __atomic_load_n(&acceptor->stop, __ATOMIC_ACQUIRE);
+
+        // In chiusura servo le connessioni gia' in coda nel kernel, poi esco
+        if(poll(&pfd, 1, stop ? 0 : 200) <= 0){
+            if(stop)
+                break;
+
+            continue;
+        }
+
         // Definizioni client
-        struct sockaddr_in client_address;
+        struct sockaddr_storage client_address;
         socklen_t client_len = sizeof(client_address);
 
         // Connessione in ingresso
-        int client_sockfd = accept(socket, (struct sockaddr*)&client_address,&client_len);
-
-        if(client_sockfd != -1)
-        {
-            // Buffer
-            uint8_t buf_0[BUFSIZE_MODBUS];
-            uint8_t buf_1[BUFSIZE_MODBUS];
-            uint8_t headerTCP[6];
-
-            ssize_t nBytes = read(client_sockfd, buf_0, BUFSIZE_TCP);
-
-            // Errore lettura
-            if(nBytes == -1)
-            {
-                close(client_sockfd);
-                continue;
-            }
+        int client_sockfd = accept(acceptor->socket, (struct sockaddr*)&client_address, &client_len);
 
-            // Scarto pacchetti troppo corti
-            if(nBytes < 8)
-            {
-                close(client_sockfd);
-                continue;
-            }
+        if(client_sockfd == -1)
+            continue;
 
-            memcpy(headerTCP, buf_0, 0);
+        // La request usa lo snapshot corrente fino alla fine della transazione
+        config *config = configAcquire();
+        transaction tx;
 
-            struct in_addr ipAddr = client_address.sin_addr;
+        traceBegin(&tx.tr);
+        configureClient(config, client_sockfd);
 
-            char clientPort[6]; 
-            char clientName[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &client_address.sin_addr, clientName, INET_ADDRSTRLEN);
+        // Request scartata: il trace va nel ring subito, altrimenti a fine transazione
+        if(acceptRequest(config, &tx, client_sockfd, &client_address) != 0){
+            traceCommit(&tx.tr);
+            close(client_sockfd);
+            configRelease(config);
+        }
+    }
 
-            // Info connessione in ingresso
-            if(settings.verbose > 1){
-                printMillis();
-                printf("Accepted connection from %s:%i\n", inet_ntoa(client_address.sin_addr), ntohs(client_address.sin_port));
-            }
+    close(acceptor->socket);
+    free(acceptor);
 
-            // Output console
-            if(settings.verbose > 1){
-                printMillis();
-                printf("<- RX TCP [%3zu]: ", nBytes);
+    return NULL;
+}
 
-                for(int i = 0; i < nBytes; i++){
-                    printf("%02x ", buf_0[i]);
-                }
+// Apro le socket in ascolto from..to-1, -1 se una non e' disponibile
+int openListeners(acceptor_t **list, int from, int to, config *config){
+    for(int i = from; i < to; i++){
+        list[i] = malloc(sizeof(acceptor_t));
 
-                printf("\n");
-            }
+        if(list[i] != NULL){
+            list[i]->socket = configureSocket(config);
+            list[i]->stop = 0;
+        }
 
-            // Controllo protocol identifier che sia 00 00
-            if(buf_0[2] != 0 || buf_0[3] != 0){
-                printf("Protocol identifier not valid [%2x %2x], for ModBus TCP it should be 0\n", buf_0[2], buf_0[3]);
-                close(client_sockfd);
-                continue;
+        if(list[i] == NULL || list[i]->socket == -1){
+            free(list[i]);
+
+            while(i-- > from){
+                close(list[i]->socket);
+                free(list[i]);
             }
 
-            ssize_t messageLen = (buf_0[4] << 8) + buf_0[5];
-            ssize_t responseLen = 0;
+            return -1;
+        }
+    }
 
-            if((messageLen + 6) != nBytes){
-                printMillis();
-                printf("ERROR: incoming buffer length [%3zu] != MosBus packet length + 6 [%3zu]\n", nBytes, messageLen);
+    return 0;
+}
+
+// Fermo i thread di accept from..to-1 senza attenderli: ogni thread serve le connessioni gia' in coda,
+// poi chiude la socket e libera il proprio acceptor_t (da non usare piu'). Un thread bloccato nella
+// lettura di un client esce al termine di quella request. Restano esposte le connessioni completate
+// tra l'ultimo accept e la close
+void stopAcceptors(acceptor_t **list, int from, int to){
+    for(int i = from; i < to; i++)
+        __atomic_store_n(&list[i]->stop, 1, __ATOMIC_RELEASE);
+}
+
+// Avvio un thread per socket (from..to-1), senza ereditare priorita' e CPU dei thread dei bus.
+// In caso di errore fermo i thread avviati e chiudo le altre socket
+int startAcceptors(acceptor_t **list, int from, int to){
+    for(int i = from; i < to; i++){
+        pthread_t thread;
+        int err = pthread_create(&thread, &acceptorAttr, acceptorLoop, list[i]);
+
+        if(err != 0){
+            printMillis();
+            printf("ERROR: Cannot start acceptor thread %i\n", i);
+
+            stopAcceptors(list, from, i);
+
+            for(int j = i; j < to; j++){
+                close(list[j]->socket);
+                free(list[j]);
             }
 
-            // FC01, FC02
-            if(buf_0[7] == 0x01 || buf_0[7] == 0x02){
-                responseLen = ((((buf_0[10]) << 8) + (buf_0[11])) / 8) + ((((buf_0[10]) << 8) + (buf_0[11])) % 8 != 0) + 5; // 1 slave id, 1 FC, 1 len, 2 byte CRC
-            }
+            return -1;
+        }
+    }
 
-            // FC03, FC04
-            else if(buf_0[7] == 0x03 || buf_0[7] == 0x04){
-                responseLen = ((((buf_0[10]) << 8) + (buf_0[11])) * 2) + 5; // 1 slave id, 1 FC, 1 len, 2 byte CRC
-            }
+    return 0;
+}
 
-            // FC05, FC06 
-            else if(buf_0[7] == 0x05 || buf_0[7] == 0x06){
-                responseLen = 8;     // Risposta a lunghezza fissa di 8 bytes
-            }
+// Seriale del bus configurata come nello snapshot indicato: dopo un reload le transazioni ammesse
+// prima usano ancora device e parametri precedenti. -1 se non disponibile
+int busSerial(config *config, int bus){
+    rtu_head *rtu = &config->rtu[bus];
 
-            // FC15, FC16
-            else if(buf_0[7] == 0x0F || buf_0[7] == 0x10){
-                responseLen = 8;     // Risposta a lunghezza fissa di 8 bytes
-            }
+    if(serialPort[bus] != -1 && !serialChanged(&serialApplied[bus], rtu))
+        return serialPort[bus];
 
-            // FC08
-            else if(buf_0[7] == 0x08){
-                responseLen = 6;     // Risposta a lunghezza fissa di 6 bytes
-            }
+    if(rtu->device[0] == 0)
+        return -1;
 
-            // Unknown Function Code
-            else{
-                printMillis();
-                printf("Unknow function code FC %2i", buf_0[7]);
-                close(client_sockfd);
-                continue;
-            }
+    if(serialPort[bus] != -1 && strncmp(serialApplied[bus].device, rtu->device, sizeof(rtu->device)) == 0){
+        // Stesso device: applico solo i nuovi parametri
+        if(applySerial(config, bus, serialPort[bus], &tty[bus]) == -1){
+            close(serialPort[bus]);
+            serialPort[bus] = -1;
+            return -1;
+        }
+    }else{
+        int port = configureSerial(config, bus, &tty[bus]);
 
-            // Creo un nuovo buffer con il pacchetto da inviare sulla 485
-            nBytes = nBytes - 6;
-            memcpy(&buf_1[0], &buf_0[6], nBytes);
+        if(port == -1)
+            return -1;
 
-            // Aggiungo il CRC ModBus
-            nBytes = addCrc16(&buf_1[0], nBytes);
+        if(serialPort[bus] != -1)
+            close(serialPort[bus]);
 
-            // Output console
-            if(settings.verbose > 1){
-                printMillis();
-                printf("-> TX RTU [%3zu]: ", nBytes);
+        serialPort[bus] = port;
+    }
 
-                for(int i = 0; i < nBytes; i++){
-                    printf("%02x ", buf_1[i]);
-                }
-                
-                printf("\n");
-            }
+    // Flush buffer input/output
+    tcflush(serialPort[bus], TCIOFLUSH);
+    serialApplied[bus] = *rtu;
 
-            // Serial.flush
-            tcflush(serialPort, TCIFLUSH);
-
-            // Invio il pacchetto sulla seriale
-            write(serialPort, buf_1, nBytes);
-
-            // Leggo risposta 485
-            nBytes = 0;
-
-            uint64_t startMillis = millis();
-            
-            // Continuo a spazzolare il buffer fino a che raggiungo la lunghezza attesa o vado in timeout
-            while(nBytes < responseLen){
-                ssize_t currRead = read(serialPort, &buf_0[nBytes], responseLen - nBytes);
-                nBytes += currRead;
-
-                if(settings.verbose > 2){
-                    printf("currRead: %zu\n", currRead);
-                }
-
-                if((millis() - startMillis) > settings.rtu.timeout){
-                    if(settings.verbose){
-                        printMillis();
-                        printf("Timed out\n");
-                    }
-                    break;
-                }
-
-                if(startMillis > millis()){
-                    if(settings.verbose){
-                        printMillis();
-                        printf("Read aborted (millis() overflow)\n");
-                    }
-                    break;
-                }
-            }
+    return serialPort[bus];
+}
 
-            // Timeout risposta
-            if(nBytes == 0){
-                close(client_sockfd);
-                continue;
-            }
+// Chiudo la seriale se il bus e' stato rimosso dalla configurazione corrente (thread del bus inattivo)
+void busSerialIdle(int bus){
+    config *config = configAcquire();
+
+    if(serialPort[bus] != -1 && config->rtu[bus].device[0] == 0){
+        close(serialPort[bus]);
+        serialPort[bus] = -1;
+    }
+
+    configRelease(config);
+}
+
+// Attesa temporizzata del thread del bus, il ritardo di risveglio e' il jitter di scheduling
+void busWaitUntil(int bus, uint64_t us){
+    if(us <= micros())
+        return;
+
+    serialWaitUntil(us);
+    rtJitterSample(bus, micros() - us);
+}
+
+// Transazione RTU eseguita dal thread del bus, poi risposta al client e chiusura della socket
+void runTransaction(transaction *tx){
+    config *config = tx->config;
+    trace_entry *tr = &tx->tr;
+    route_entry *route = &tx->route;
+    rtu_head *rtu = &config->rtu[route->bus];
+    int client_sockfd = tx->client_sockfd;
+
+    // Buffer
+    uint8_t buf_0[BUFSIZE_TCP];
+    uint8_t buf_1[BUFSIZE_TCP];
+    ssize_t nBytes = tx->rtuLen;
+    ssize_t responseLen = tx->responseLen;
+
+    traceMark(tr, TRACE_QUEUE_OUT);
+
+    // Scarto le request che nessuno leggera': deadline superata o client disconnesso
+    uint64_t age = millis() - tx->arrivalMillis;
+
+    if(tx->deadline > 0 && age > (uint64_t)tx->deadline){
+        if(config->verbose){
+            printMillis();
+            printf("Request from %s dropped, expired (%llu ms > %li ms)\n", tx->clientName, (unsigned long long)age, tx->deadline);
+        }
+
+        STATS_INC(dropExpired);
+        return;
+    }
+
+    if(clientGone(client_sockfd, tx->halfClose)){
+        if(config->verbose){
+            printMillis();
+            printf("Request from %s dropped, client disconnected\n", tx->clientName);
+        }
+
+        STATS_INC(dropOrphaned);
+        return;
+    }
+
+    // Seriale con i parametri dello snapshot della transazione
+    int port = busSerial(config, route->bus);
+
+    if(port == -1){
+        printMillis();
+        printf("Serial port of bus %i not available\n", route->bus + 1);
+        sendException(config, client_sockfd, &tx->mbap, tx->rtu[1], MB_EX_GATEWAY_PATH_UNAVAILABLE);
+        return;
+    }
+
+    // Output console
+    if(config->verbose > 1){
+        printMillis();
+        printf("-> TX RTU [%3zu]: ", nBytes);
+
+        for(int i = 0; i < nBytes; i++){
+            printf("%02x ", tx->rtu[i]);
+        }
+        
+        printf("\n");
+    }
+
+    // Silenzio minimo dalla fine del frame precedente
+    busWaitUntil(route->bus, busIdleUs[route->bus]);
+
+    // Serial.flush
+    tcflush(port, TCIFLUSH);
+
+    // Invio il pacchetto sulla seriale e attendo che l'ultimo carattere sia uscito
+    uint32_t charUs = busCharTime(rtu);
 
-            // Output console
-            if(settings.verbose > 1){
+    uint64_t txStartUs = traceMark(tr, TRACE_SER_TX_START);
+    writeAll(port, tx->rtu, nBytes, 0);
+    serialWaitTxEmpty(port, txStartUs + nBytes * charUs, charUs);
+    uint64_t txEndUs = traceMark(tr, TRACE_SER_TX_END);
+
+    // Turnaround TX -> RX
+    if(rtu->turnaroundUs > 0)
+        busWaitUntil(route->bus, txEndUs + rtu->turnaroundUs);
+
+    // Leggo risposta 485
+    nBytes = 0;
+
+    uint64_t timeoutMillis = millis() + rtu->timeout;
+
+    // Attendo i dati in poll() fino alla lunghezza attesa o al timeout: niente busy loop anche con VMIN = VTIME = 0
+    while(nBytes < responseLen){
+        int64_t remaining = (int64_t)(timeoutMillis - millis());
+
+        if(remaining <= 0){
+            if(config->verbose){
                 printMillis();
-                printf("<- RX RTU [%3zu]: ", nBytes);
-                
-                for(int i = 0; i < nBytes; i++){
-                    printf("%02x ", buf_0[i]);
-                }
-                
-                printf("\n");
+                printf("Timed out\n");
             }
+            break;
+        }
+
+        struct pollfd pfd = { .fd = port, .events = POLLIN };
+        int ready = poll(&pfd, 1, remaining);
+
+        if(ready == -1 && errno != EINTR)
+            break;
+
+        if(ready <= 0)
+            continue;
+
+        ssize_t currRead = read(port, &buf_0[nBytes], responseLen - nBytes);
+
+        if(currRead == -1 && errno == EINTR)
+            continue;
+
+        if(config->verbose > 2){
+            printf("currRead: %zd\n", currRead);
+        }
+
+        if(currRead > 0){
+            if(nBytes == 0)
+                traceMark(tr, TRACE_SER_RX_FIRST);
+
+            traceMark(tr, TRACE_SER_RX_LAST);
+
+            nBytes += currRead;
+
+            // Risposta di eccezione dallo slave: lunghezza fissa, non attendo il timeout
+            responseLen = mbRtuExpectedLen(buf_0, nBytes, responseLen);
+        }
+        else if(pfd.revents & (POLLERR | POLLHUP | POLLNVAL)){
+            printMillis();
+            printf("ERROR: Serial port of bus %i not readable\n", route->bus + 1);
+            break;
+        }
+    }
+
+    // Prossima request solo dopo il silenzio di fine frame
+    busIdleUs[route->bus] = micros() + rtu->interframeUs;
+
+    // Timeout risposta
+    if(nBytes == 0){
+        STATS_INC(timeouts);
+        return;
+    }
+
+    // Output console
+    if(config->verbose > 1){
+        printMillis();
+        printf("<- RX RTU [%3zu]: ", nBytes);
+        
+        for(int i = 0; i < nBytes; i++){
+            printf("%02x ", buf_0[i]);
+        }
+        
+        printf("\n");
+    }
+
+    // Check CRC
+    if(checkCrc16(buf_0, nBytes)){
+        printMillis();
+        printf("ERROR: Invalid CRC on [%3zu] bytes received from RTU\n", nBytes);
+        STATS_INC(crcErrors);
+        return;
+    }
+
+    // Pubblico i valori letti per i processi locali
+    if(tx->quantity && buf_0[1] == tx->rtu[1] && buf_0[2] == nBytes - 5)
+        regimagePublish(tx->unitId, buf_0[1], tx->startAddr, tx->quantity, &buf_0[3], buf_0[2]);
+
+    if(nBytes > 2){
+        // Ripristino unit ID e indirizzo originali verso il client TCP
+        buf_0[0] = tx->unitId;
+
+        if(route->offset != 0 && nBytes >= 6 && mbFc(buf_0[1])->echoAddress){
+            long address = ((buf_0[2] << 8) + buf_0[3]) - route->offset;
+
+            buf_0[2] = (address >> 8) & 0xFF;
+            buf_0[3] = address & 0xFF;
+        }
+
+        // Header con transaction ID della request e lunghezza della risposta
+        nBytes = mbBuildTcp(&tx->mbap, buf_0, nBytes, buf_1, BUFSIZE_TCP);
+
+        // Output console
+        if(config->verbose > 1){
+            printMillis();
+            printf("-> TX TCP [%3zu]: ", nBytes);
 
-            // Check CRC
-            if(checkCrc16(buf_0, nBytes)){
-                close(client_sockfd);
-                continue;
+            for(int i = 0; i < nBytes; i++){
+                printf("%02x ", buf_1[i]);
             }
 
-            // I primi 6 byte del pacchetto (header) sono uguali alla request
-            memcpy(&buf_1, &headerTCP, 6);
+            printf("\n");
+        }
 
-            if(nBytes > 2){
-                memcpy(&buf_1[6], &buf_0, nBytes - 2);
-                nBytes = nBytes + 4;
+        // Invio il pacchetto TCP
+        writeAll(client_sockfd, buf_1, nBytes, 1);
+        traceMark(tr, TRACE_TCP_TX);
+        STATS_INC(responses);
+    }else{
+        printMillis();
+        printf("Not enough bytes received from RTU\n");
+    }
+}
 
-                // Output console
-                if(settings.verbose > 1){
-                    printMillis();
-                    printf("-> TX TCP [%3zu]: ", nBytes);
+// Thread del bus: esegue in ordine le transazioni della propria coda. Le transazioni di un bus sono
+// strettamente sequenziali, un timeout su un bus non ritarda gli altri
+void *busLoop(void *arg){
+    int bus = (int)(intptr_t)arg;
+    config *config = configAcquire();
 
-                    for(int i = 0; i < nBytes; i++){
-                        printf("%02x ", buf_1[i]);
-                    }
+    // rt_* non cambia con il reload
+    if(config->rt.enable)
+        rtPrefaultStack();
 
-                    printf("\n");
-                }
+    configRelease(config);
 
-                // Invio il pacchetto TCP
-                write(client_sockfd, buf_1, nBytes);
-            }else{
-                printMillis();
-                printf("Not enough bytes received from RTU\n");
+    while (1) {
+        transaction tx;
+
+        if(queuePop(bus, &tx, 200) == -1){
+            pthread_mutex_lock(&busLock[bus]);
+            busSerialIdle(bus);
+            pthread_mutex_unlock(&busLock[bus]);
+            continue;
+        }
+
+        pthread_mutex_lock(&busLock[bus]);
+        runTransaction(&tx);
+        pthread_mutex_unlock(&busLock[bus]);
+
+        busLoadDone(bus, tx.wireUs);
+        traceCommit(&tx.tr);
+
+        // Chiudo la socket e rilascio lo snapshot della transazione
+        close(tx.client_sockfd);
+        configRelease(tx.config);
+    }
+
+    return NULL;
+}
+
+// Avvio il thread del bus se non e' gia' attivo (bus aggiunto dal reload), -1 se non avviabile
+int startBus(int bus){
+    if(busStarted[bus])
+        return 0;
+
+    int err = pthread_create(&busThread[bus], &busAttr, busLoop, (void *)(intptr_t)bus);
+
+    if(err != 0){
+        printMillis();
+        printf("ERROR: Cannot start thread of bus %i: %s\n", bus + 1, strerror(err));
+        return -1;
+    }
+
+    busStarted[bus] = 1;
+
+    return 0;
+}
+
+// Seriale del bus verificata o ripristinata dal reload, con la linea libera
+int reloadSerial(config *config, int bus){
+    pthread_mutex_lock(&busLock[bus]);
+    int port = busSerial(config, bus);
+    pthread_mutex_unlock(&busLock[bus]);
+
+    return port;
+}
+
+// Reload non applicabile: seriali riportate ai parametri correnti, nuovo snapshot scartato
+void reloadRollback(config *old, config *new, const int *changed){
+    for(int i = 0; i < MAX_RTU_BUS; i++){
+        if(changed[i] && old->rtu[i].device[0] != 0 && reloadSerial(old, i) == -1){
+            printMillis();
+            printf("ERROR: Cannot restore serial configuration of bus %i\n", i + 1);
+        }
+    }
+
+    printMillis();
+    printf("ERROR: Reload failed, keeping current configuration\n");
+
+    free(new);
+    configRelease(old);
+}
+
+// Rilettura della configurazione (SIGHUP): nuovo snapshot, riconfiguro solo seriali e socket cambiate.
+// Eseguita dal thread principale; le seriali sono verificate tra due transazioni del loro bus.
+// In caso di errore resta la configurazione corrente
+void reloadConfig(void){
+    config *old = configAcquire();
+    config *new = calloc(1, sizeof(config));
+    int changed[MAX_RTU_BUS] = { 0 };
+    int reconfigured = 0;
+
+    printMillis();
+    printf("Reloading configuration\n");
+
+    if(new == NULL || readConfig(new, configPath) == -1){
+        printMillis();
+        printf("ERROR: Reload failed, keeping current configuration\n");
+        free(new);
+        configRelease(old);
+        return;
+    }
+
+    // Modalita' real-time e memoria condivisa restano quelle dell'avvio
+    if(memcmp(&new->rt, &old->rt, sizeof(rt_head)) != 0 || strcmp(new->shmName, old->shmName) != 0){
+        printMillis();
+        printf("rt_* and shm_name changes require a restart, ignored\n");
+
+        new->rt = old->rt;
+        memcpy(new->shmName, old->shmName, sizeof(new->shmName));
+    }
+
+    // Seriali cambiate: i nuovi parametri vengono applicati subito per verificarli.
+    // Le transazioni in coda ammesse con il vecchio snapshot li ripristinano con busSerial.
+    // I bus aggiunti ricevono il proprio thread
+    for(int i = 0; i < MAX_RTU_BUS; i++){
+        if(!serialChanged(&old->rtu[i], &new->rtu[i]))
+            continue;
+
+        changed[i] = 1;
+        reconfigured++;
+
+        if(new->rtu[i].device[0] != 0 && (reloadSerial(new, i) == -1 || startBus(i) == -1)){
+            reloadRollback(old, new, changed);
+            return;
+        }
+    }
+
+    // Socket in ascolto: riaperte solo se cambia indirizzo o porta, altrimenti aggiornate.
+    // I nuovi thread partono prima della pubblicazione dello snapshot
+    acceptor_t *fresh[MAX_ACCEPTORS];
+    int count = acceptorCount;
+    int reopen = listenerChanged(&old->tcp, &new->tcp);
+    int tuned = !reopen && listenerTuned(&old->tcp, &new->tcp);
+    int acceptors = new->tcp.acceptors;
+
+    if(reopen){
+        if(openListeners(fresh, 0, acceptors, new) == -1 || startAcceptors(fresh, 0, acceptors) == -1){
+            reloadRollback(old, new, changed);
+            return;
+        }
+    }
+    else if(tuned){
+        int kept = acceptors < count ? acceptors : count;
+
+        for(int i = 0; i < kept; i++){
+            if(configureListener(new, acceptorList[i]->socket) == -1){
+                while(i-- > 0)
+                    configureListener(old, acceptorList[i]->socket);
+
+                reloadRollback(old, new, changed);
+                return;
             }
+        }
 
-            // Chiudo la socket
-            close(client_sockfd);
+        if(acceptors > count && (openListeners(acceptorList, count, acceptors, new) == -1 || startAcceptors(acceptorList, count, acceptors) == -1)){
+            for(int i = 0; i < kept; i++)
+                configureListener(old, acceptorList[i]->socket);
+
+            reloadRollback(old, new, changed);
+            return;
+        }
+    }
+
+    // Da qui le nuove request usano il nuovo snapshot, quelle in coda mantengono il precedente
+    configPublish(new);
+
+    // I vecchi thread si fermano da soli: il reload non attende le loro connessioni
+    if(reopen){
+        stopAcceptors(acceptorList, 0, count);
+        memcpy(acceptorList, fresh, acceptors * sizeof(fresh[0]));
+        acceptorCount = acceptors;
+    }
+    else if(tuned){
+        if(acceptors < count)
+            stopAcceptors(acceptorList, acceptors, count);
+
+        acceptorCount = acceptors;
+    }
+
+    printMillis();
+    printf("Configuration reloaded: %i serial ports reconfigured, listeners %s\n", reconfigured,
+           reopen ? "reopened" : tuned ? "updated" : "unchanged");
+
+    configRelease(old);
+}
+
+int main(int argc, char *argv[]){
+    int opt;
+
+    while((opt = getopt(argc, argv, "c:")) != -1){
+        if(opt == 'c'){
+            configPath = optarg;
+        }else{
+            printf("Usage: %s [-c <config file>]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("\n");
+    printf("------------------------------------\n");
+    printf("------ GW Modbus TCP <-> RTU  ------\n");
+    printf("------------------------------------\n");
+    printf("\n");
+    printf("Version: %s\n", version);
+    printf("\n");
+
+    // Leggo la configurazione dal file .ini
+    config *config = calloc(1, sizeof(*config));
+
+    if(config == NULL || readConfig(config, configPath) == -1){
+        exit(EXIT_FAILURE);
+    }
+
+    configPublish(config);
+
+    // Configuro le seriali
+    for(int i = 0; i < MAX_RTU_BUS; i++)
+        serialPort[i] = -1;
+
+    for(int i = 0; i < MAX_RTU_BUS; i++){
+        if(config->rtu[i].device[0] != 0 && busSerial(config, i) == -1){
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Info
+    if(config->verbose){
+        printMillis();
+        printf("Starting server at %s:%i (%i acceptors, backlog %i)\n", config->tcp.address, config->tcp.port, config->tcp.acceptors, config->tcp.backlog);
+    }
+
+    // Immagine registri in memoria condivisa
+    if(config->shmName[0] != 0){
+        if(regimageCreate(config->shmName) == -1){
+            printMillis();
+            printf("ERROR: Cannot create shared memory %s\n", config->shmName);
+            exit(EXIT_FAILURE);
+        }
+
+        if(config->verbose){
+            printMillis();
+            printf("Publishing register image on shared memory %s\n", config->shmName);
+        }
+    }
+
+    // SIGUSR1 -> dump delle ultime transazioni, SIGHUP -> reload configurazione.
+    // Bloccati prima di creare i thread, che ereditano la maschera, e attesi con sigwait dal thread
+    // principale: non interrompono l'I/O dei client e delle seriali e non ritardano i bus
+    sigset_t signals;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    // Thread di accept: SCHED_OTHER e CPU dell'avvio, indipendenti dalla modalita' real-time dei bus
+    struct sched_param param;
+    cpu_set_t cpus;
+
+    memset(&param, 0, sizeof(param));
+    sched_getaffinity(0, sizeof(cpus), &cpus);
+
+    pthread_attr_init(&acceptorAttr);
+    pthread_attr_setdetachstate(&acceptorAttr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&acceptorAttr, ACCEPTOR_STACK);
+    pthread_attr_setinheritsched(&acceptorAttr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&acceptorAttr, SCHED_OTHER);
+    pthread_attr_setschedparam(&acceptorAttr, &param);
+    pthread_attr_setaffinity_np(&acceptorAttr, sizeof(cpus), &cpus);
+
+    // Configuro socket e thread di accept
+    if(openListeners(acceptorList, 0, config->tcp.acceptors, config) == -1 || startAcceptors(acceptorList, 0, config->tcp.acceptors) == -1){
+        exit(EXIT_FAILURE);
+    }
+
+    acceptorCount = config->tcp.acceptors;
+
+    // Modalita' real-time: memoria bloccata, thread dei bus in SCHED_FIFO sulla CPU rt_cpu
+    pthread_attr_init(&busAttr);
+    pthread_attr_setstacksize(&busAttr, BUS_STACK);
+
+    if(config->rt.enable){
+        if(rtSetup(config) == -1){
+            exit(EXIT_FAILURE);
+        }
+
+        rtThreadAttr(config, &busAttr);
+    }
+
+    // Un thread per bus configurato
+    for(int i = 0; i < MAX_RTU_BUS; i++){
+        if(config->rtu[i].device[0] != 0 && startBus(i) == -1){
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(config->verbose){
+        printMillis();
+        printf("Ok, Running\n\n");
+    }
+
+    // Thread principale: solo segnali, nessuna transazione
+    while (1) {
+        int sig;
+
+        if(sigwait(&signals, &sig) != 0)
+            continue;
+
+        if(sig == SIGHUP){
+            reloadConfig();
+            continue;
         }
+
+        traceDump(stdout);
+        statsDump(stdout);
+
+        config = configAcquire();
+        busLoadDump(stdout, config);
+        queueDump(stdout, config);
+        rtJitterDump(stdout, config);
+        configRelease(config);
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -1,6 +1,6 @@
 
 // Def. buffer size
 #define BUFSIZE_MODBUS  256
-#define BUFSIZE_TCP     256
+#define BUFSIZE_TCP     260
 
 #define version         "1.0"
\ No newline at end of file
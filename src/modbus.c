@@ -0,0 +1,204 @@
+/**
+ * @file modbus.c
+ * @author Federico Turco ()
+ * @brief Codec ModBus TCP / RTU (libmbcodec): nessuna allocazione, solo buffer del chiamante
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "modbus.h"
+#include "crc.h"
+
+// Function code supportati, tutti gli altri restano a zero (MB_RESP_NONE)
+const mb_fc_desc mbFcTable[256] = {
+    // Read Coils, Read Discrete Inputs: slave ID, FC, byte count, CRC + bit
+    [0x01] = { .respKind = MB_RESP_BITS,  .respLen = 5, .minPduLen = 5, .hasAddress = 1, .maxQuantity = 2000 },
+    [0x02] = { .respKind = MB_RESP_BITS,  .respLen = 5, .minPduLen = 5, .hasAddress = 1, .maxQuantity = 2000 },
+
+    // Read Holding / Input Registers: slave ID, FC, byte count, CRC + registri
+    [0x03] = { .respKind = MB_RESP_REGS,  .respLen = 5, .minPduLen = 5, .hasAddress = 1, .maxQuantity = 125 },
+    [0x04] = { .respKind = MB_RESP_REGS,  .respLen = 5, .minPduLen = 5, .hasAddress = 1, .maxQuantity = 125 },
+
+    // Write Single Coil / Register: risposta eco di 8 bytes
+    [0x05] = { .respKind = MB_RESP_FIXED, .respLen = 8, .minPduLen = 5, .hasAddress = 1, .echoAddress = 1, .write = 1 },
+    [0x06] = { .respKind = MB_RESP_FIXED, .respLen = 8, .minPduLen = 5, .hasAddress = 1, .echoAddress = 1, .write = 1 },
+
+    // Diagnostics: la risposta e' l'eco della request
+    [0x08] = { .respKind = MB_RESP_ECHO,  .respLen = 0, .minPduLen = 5 },
+
+    // Write Multiple Coils / Registers: risposta di 8 bytes
+    [0x0F] = { .respKind = MB_RESP_FIXED, .respLen = 8, .minPduLen = 7, .hasAddress = 1, .echoAddress = 1, .itemBits = 1, .write = 1, .maxQuantity = 1968 },
+    [0x10] = { .respKind = MB_RESP_FIXED, .respLen = 8, .minPduLen = 8, .hasAddress = 1, .echoAddress = 1, .itemBits = 16, .write = 1, .maxQuantity = 123 },
+};
+
+// Decodifica l'header MBAP, ritorna la lunghezza del frame TCP (header + PDU) o -1
+ssize_t mbParseMbap(const uint8_t *buf, ssize_t len, mbap_header *mbap)
+{
+    // Header + almeno il function code
+    if(len < MB_MBAP_LEN + 1)
+        return -1;
+
+    mbap->transactionId = (buf[0] << 8) + buf[1];
+    mbap->protocolId    = (buf[2] << 8) + buf[3];
+    mbap->length        = (buf[4] << 8) + buf[5];
+    mbap->unitId        = buf[6];
+
+    // Protocol identifier per ModBus TCP = 0
+    if(mbap->protocolId != 0)
+        return -1;
+
+    // Length comprende unit ID e PDU
+    if(mbap->length < 2 || mbap->length > MB_PDU_MAX + 1)
+        return -1;
+
+    // Frame troncato
+    if(mbap->length + 6 > len)
+        return -1;
+
+    return mbap->length + 6;
+}
+
+// Verifica la PDU della request, ritorna 0 o il codice di eccezione da inviare al client
+uint8_t mbValidatePdu(const uint8_t *pdu, ssize_t pduLen)
+{
+    const mb_fc_desc *desc = mbFc(pdu[0]);
+
+    if(desc->respKind == MB_RESP_NONE)
+        return MB_EX_ILLEGAL_FUNCTION;
+
+    if(pduLen < desc->minPduLen)
+        return MB_EX_ILLEGAL_DATA_VALUE;
+
+    if(desc->maxQuantity){
+        int quantity = (pdu[3] << 8) + pdu[4];
+
+        if(quantity < 1 || quantity > desc->maxQuantity)
+            return MB_EX_ILLEGAL_DATA_VALUE;
+
+        // Indirizzo + quantity oltre lo spazio di indirizzamento
+        if(((pdu[1] << 8) + pdu[2]) + quantity > 0x10000)
+            return MB_EX_ILLEGAL_DATA_ADDRESS;
+    }
+
+    if(desc->itemBits){
+        int quantity = (pdu[3] << 8) + pdu[4];
+        int byteCount = (quantity * desc->itemBits + 7) / 8;
+
+        if(pdu[5] != byteCount || pduLen != 6 + byteCount)
+            return MB_EX_ILLEGAL_DATA_VALUE;
+    }
+
+    // Write Single Coil: solo 0x0000 o 0xFF00
+    if(pdu[0] == 0x05 && !((pdu[3] == 0x00 || pdu[3] == 0xFF) && pdu[4] == 0x00))
+        return MB_EX_ILLEGAL_DATA_VALUE;
+
+    return 0;
+}
+
+// Lunghezza attesa della risposta RTU (slave ID + PDU + CRC), -1 se non prevedibile
+ssize_t mbResponseLen(const uint8_t *pdu, ssize_t pduLen)
+{
+    const mb_fc_desc *desc = mbFc(pdu[0]);
+    ssize_t responseLen;
+
+    if(pduLen < 1 || pduLen < desc->minPduLen)
+        return -1;
+
+    int quantity = desc->maxQuantity ? (pdu[3] << 8) + pdu[4] : 0;
+
+    switch(desc->respKind){
+        case MB_RESP_FIXED:
+            responseLen = desc->respLen;
+            break;
+
+        case MB_RESP_BITS:
+            responseLen = desc->respLen + (quantity + 7) / 8;
+            break;
+
+        case MB_RESP_REGS:
+            responseLen = desc->respLen + quantity * 2;
+            break;
+
+        case MB_RESP_ECHO:
+            responseLen = pduLen + 3;       // Slave ID + PDU + CRC
+            break;
+
+        default:
+            return -1;
+    }
+
+    // La risposta deve stare in un ADU RTU
+    if(responseLen > MB_RTU_ADU_MAX)
+        return -1;
+
+    return responseLen;
+}
+
+// Byte da attendere dallo slave dopo rxLen ricevuti: una risposta di eccezione ha lunghezza fissa
+ssize_t mbRtuExpectedLen(const uint8_t *rtu, ssize_t rxLen, ssize_t responseLen)
+{
+    if(rxLen >= 2 && (rtu[1] & 0x80))
+        return MB_RTU_EXCEPTION_LEN;
+
+    return responseLen;
+}
+
+// Frame TCP (gia' validato con mbParseMbap) -> frame RTU con CRC, ritorna la lunghezza o -1
+ssize_t mbBuildRtu(const uint8_t *tcp, ssize_t tcpLen, uint8_t *rtu, ssize_t rtuSize)
+{
+    ssize_t len = tcpLen - 6;
+
+    if(len < 2 || len + 2 > rtuSize)
+        return -1;
+
+    memcpy(rtu, &tcp[6], len);
+
+    return addCrc16(rtu, len);
+}
+
+// Frame RTU (CRC gia' verificato) -> frame TCP con l'header della richiesta, ritorna la lunghezza o -1
+ssize_t mbBuildTcp(const mbap_header *mbap, const uint8_t *rtu, ssize_t rtuLen, uint8_t *tcp, ssize_t tcpSize)
+{
+    // Slave ID + FC + CRC
+    ssize_t len = rtuLen - 2;
+
+    if(len < 2 || len + 6 > tcpSize)
+        return -1;
+
+    tcp[0] = mbap->transactionId >> 8;
+    tcp[1] = mbap->transactionId & 0xFF;
+    tcp[2] = 0;
+    tcp[3] = 0;
+    tcp[4] = len >> 8;
+    tcp[5] = len & 0xFF;
+
+    memcpy(&tcp[6], rtu, len);
+
+    return len + 6;
+}
+
+// Risposta di eccezione TCP per la request con header mbap, ritorna la lunghezza o -1
+ssize_t mbBuildException(const mbap_header *mbap, uint8_t fc, uint8_t code, uint8_t *tcp, ssize_t tcpSize)
+{
+    if(tcpSize < MB_TCP_EXCEPTION_LEN)
+        return -1;
+
+    tcp[0] = mbap->transactionId >> 8;
+    tcp[1] = mbap->transactionId & 0xFF;
+    tcp[2] = 0;
+    tcp[3] = 0;
+    tcp[4] = 0;
+    tcp[5] = 3;             // Unit ID, FC, codice
+    tcp[6] = mbap->unitId;
+    tcp[7] = fc | 0x80;
+    tcp[8] = code;
+
+    return MB_TCP_EXCEPTION_LEN;
+}
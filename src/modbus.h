@@ -0,0 +1,79 @@
+/**
+ * @file modbus.h
+ * @author Federico Turco ()
+ * @brief Codec ModBus TCP / RTU (libmbcodec): nessuna allocazione, solo buffer del chiamante
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#ifndef MODBUS_H
+#define MODBUS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Limiti da specifica ModBus
+#define MB_PDU_MAX              253     // FC + dati
+#define MB_RTU_ADU_MAX          256     // Slave ID + PDU + CRC
+#define MB_TCP_ADU_MAX          260     // MBAP (7) + PDU
+#define MB_MBAP_LEN             7       // Transaction ID, Protocol ID, Length, Unit ID
+#define MB_RTU_EXCEPTION_LEN    5       // Slave ID, FC | 0x80, codice, CRC
+#define MB_TCP_EXCEPTION_LEN    9       // MBAP, FC | 0x80, codice
+
+// Codici di eccezione
+#define MB_EX_ILLEGAL_FUNCTION          0x01
+#define MB_EX_ILLEGAL_DATA_ADDRESS      0x02
+#define MB_EX_ILLEGAL_DATA_VALUE        0x03
+#define MB_EX_SLAVE_DEVICE_FAILURE      0x04
+#define MB_EX_SLAVE_DEVICE_BUSY         0x06
+#define MB_EX_GATEWAY_PATH_UNAVAILABLE  0x0A
+#define MB_EX_GATEWAY_TARGET_FAILED     0x0B
+
+// Calcolo lunghezza risposta RTU
+typedef enum{
+    MB_RESP_NONE = 0,       // Function code non supportato
+    MB_RESP_FIXED,          // Lunghezza fissa (respLen)
+    MB_RESP_BITS,           // respLen + quantity / 8 arrotondato
+    MB_RESP_REGS,           // respLen + quantity * 2
+    MB_RESP_ECHO            // Uguale alla request (FC08)
+} mb_resp_kind;
+
+// Descrittore function code
+typedef struct{
+    uint8_t respKind;       // mb_resp_kind
+    uint8_t respLen;        // ADU RTU fissa o parte fissa (slave ID, FC, byte count, CRC)
+    uint8_t minPduLen;      // Lunghezza minima PDU della request
+    uint8_t hasAddress;     // Indirizzo registro in pdu[1..2]
+    uint8_t echoAddress;    // La risposta riporta l'indirizzo in pdu[1..2]
+    uint8_t itemBits;       // Bit per elemento dei dati dopo il byte count in pdu[5] (FC15 = 1, FC16 = 16), 0 = nessun byte count
+    uint8_t write;          // Scrive sullo slave
+    uint16_t maxQuantity;   // Quantity in pdu[3..4], 0 = nessuna quantity
+} mb_fc_desc;
+
+// Header MBAP
+typedef struct{
+    uint16_t transactionId;
+    uint16_t protocolId;
+    uint16_t length;                // Unit ID + PDU
+    uint8_t unitId;
+} mbap_header;
+
+// Tabella indicizzata per function code, generata a compile time
+extern const mb_fc_desc mbFcTable[256];
+
+static inline const mb_fc_desc *mbFc(uint8_t fc){
+    return &mbFcTable[fc];
+}
+
+ssize_t mbParseMbap(const uint8_t *buf, ssize_t len, mbap_header *mbap);
+uint8_t mbValidatePdu(const uint8_t *pdu, ssize_t pduLen);
+ssize_t mbResponseLen(const uint8_t *pdu, ssize_t pduLen);
+ssize_t mbRtuExpectedLen(const uint8_t *rtu, ssize_t rxLen, ssize_t responseLen);
+ssize_t mbBuildRtu(const uint8_t *tcp, ssize_t tcpLen, uint8_t *rtu, ssize_t rtuSize);
+ssize_t mbBuildTcp(const mbap_header *mbap, const uint8_t *rtu, ssize_t rtuLen, uint8_t *tcp, ssize_t tcpSize);
+ssize_t mbBuildException(const mbap_header *mbap, uint8_t fc, uint8_t code, uint8_t *tcp, ssize_t tcpSize);
+
+#endif
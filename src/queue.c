@@ -0,0 +1,131 @@
+/**
+ * @file queue.c
+ * @author Federico Turco ()
+ * @brief Code delle transazioni tra thread di accept e thread dei bus (una per bus)
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "queue.h"
+
+// Una coda per bus, ring statico: nessuna allocazione a runtime
+typedef struct{
+    transaction ring[QUEUE_SIZE];
+    int head;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+} bus_queue;
+
+static bus_queue queues[MAX_RTU_BUS];
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+// Condition variable su CLOCK_MONOTONIC per il timeout di queuePop
+static void queueInit(void)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+    for(int i = 0; i < MAX_RTU_BUS; i++){
+        pthread_mutex_init(&queues[i].lock, NULL);
+        pthread_cond_init(&queues[i].notEmpty, &attr);
+    }
+
+    pthread_condattr_destroy(&attr);
+}
+
+// Accoda la transazione sul bus indicato, -1 se la coda e' piena
+int queuePush(int bus, const transaction *tx)
+{
+    bus_queue *q = &queues[bus];
+
+    pthread_once(&once, queueInit);
+    pthread_mutex_lock(&q->lock);
+
+    if(q->count == QUEUE_SIZE){
+        pthread_mutex_unlock(&q->lock);
+        return -1;
+    }
+
+    q->ring[(q->head + q->count) % QUEUE_SIZE] = *tx;
+    q->count++;
+
+    pthread_cond_signal(&q->notEmpty);
+    pthread_mutex_unlock(&q->lock);
+
+    return 0;
+}
+
+// Estrae la transazione piu' vecchia del bus, -1 se la coda resta vuota per timeoutMs
+int queuePop(int bus, transaction *tx, int timeoutMs)
+{
+    bus_queue *q = &queues[bus];
+    struct timespec deadline;
+
+    pthread_once(&once, queueInit);
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000;
+
+    if(deadline.tv_nsec >= 1000000000){
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&q->lock);
+
+    while(q->count == 0){
+        if(pthread_cond_timedwait(&q->notEmpty, &q->lock, &deadline) == ETIMEDOUT && q->count == 0){
+            pthread_mutex_unlock(&q->lock);
+            return -1;
+        }
+    }
+
+    *tx = q->ring[q->head];
+    q->head = (q->head + 1) % QUEUE_SIZE;
+    q->count--;
+
+    pthread_mutex_unlock(&q->lock);
+
+    return 0;
+}
+
+// Transazioni in attesa sul bus
+int queueDepth(int bus)
+{
+    bus_queue *q = &queues[bus];
+
+    pthread_once(&once, queueInit);
+    pthread_mutex_lock(&q->lock);
+    int depth = q->count;
+    pthread_mutex_unlock(&q->lock);
+
+    return depth;
+}
+
+void queueDump(FILE *out, config *config)
+{
+    fprintf(out, "\nQueues\n");
+
+    for(int i = 0; i < config->nBus; i++){
+        if(config->rtu[i].device[0] == 0)
+            continue;
+
+        fprintf(out, "  bus %i %-20s %3i of %i\n", i + 1, config->rtu[i].device, queueDepth(i), QUEUE_SIZE);
+    }
+
+    fflush(out);
+}
@@ -0,0 +1,53 @@
+/**
+ * @file queue.h
+ * @author Federico Turco ()
+ * @brief Code delle transazioni tra thread di accept e thread dei bus (una per bus)
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <termios.h>
+
+#include "config.h"
+#include "modbus.h"
+#include "trace.h"
+
+// Transazioni in attesa per bus, pre-allocate
+#define QUEUE_SIZE      64
+
+// Request gia' validata e tradotta, in attesa del bus
+typedef struct{
+    int client_sockfd;
+    char clientName[46];
+    mbap_header mbap;
+    route_entry route;
+    uint8_t unitId;             // Unit ID lato TCP
+    uint16_t startAddr;         // Range richiesto lato TCP, prima del remap
+    uint16_t quantity;
+    uint8_t rtu[MB_RTU_ADU_MAX];
+    ssize_t rtuLen;
+    ssize_t responseLen;
+    uint32_t wireUs;            // Tempo di bus stimato
+    uint64_t arrivalMillis;
+    long deadline;              // ms, dalla regola del client o tcp_timeout (0 = nessuna)
+    int priority;               // Priorita' del client, risolta all'accept
+    int halfClose;              // Il client chiude in scrittura e attende la risposta
+    trace_entry tr;             // Trace della transazione, copiato nel ring a fine transazione
+    config *config;             // Snapshot della configurazione con cui e' stata ammessa
+} transaction;
+
+int queuePush(int bus, const transaction *tx);
+int queuePop(int bus, transaction *tx, int timeoutMs);
+int queueDepth(int bus);
+void queueDump(FILE *out, config *config);
+
+#endif
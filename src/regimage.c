@@ -0,0 +1,115 @@
+/**
+ * @file regimage.c
+ * @author Federico Turco ()
+ * @brief Pubblicazione dell'immagine registri in memoria condivisa (lato gateway)
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "regimage.h"
+
+// Segmento mappato, NULL se la pubblicazione e' disabilitata
+static regimage *image = NULL;
+
+// Un solo scrittore alla volta per il seqlock: i thread dei bus possono contendersi lo stesso slot
+static pthread_mutex_t writeLock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t clockUs(clockid_t clock)
+{
+    struct timespec spec;
+    clock_gettime(clock, &spec);
+
+    return (uint64_t)spec.tv_sec * 1000000 + (uint64_t)spec.tv_nsec / 1000;
+}
+
+// Crea (o riapre) il segmento, 0 se ok
+int regimageCreate(const char *name)
+{
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+
+    if(fd == -1){
+        perror("shm_open");
+        return -1;
+    }
+
+    if(ftruncate(fd, sizeof(regimage)) == -1){
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+
+    // MAP_POPULATE: nessun page fault durante le transazioni
+    void *p = mmap(NULL, sizeof(regimage), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+
+    if(p == MAP_FAILED){
+        perror("mmap");
+        return -1;
+    }
+
+    image = (regimage *)p;
+
+    // Il contenuto di un gateway precedente viene scartato
+    memset(image, 0, sizeof(regimage));
+    image->version = REGIMAGE_VERSION;
+    image->nSlots = REGIMAGE_SLOTS;
+    image->slotSize = sizeof(regimage_slot);
+    __atomic_store_n(&image->magic, REGIMAGE_MAGIC, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void regimagePublish(uint8_t unit, uint8_t fc, uint16_t start, uint16_t count, const uint8_t *data, uint16_t len)
+{
+    if(image == NULL || count == 0 || len > REGIMAGE_DATA)
+        return;
+
+    uint32_t h = regimageHash(unit, fc, start, count);
+    regimage_slot *slot = NULL;
+
+    pthread_mutex_lock(&writeLock);
+
+    // Stesso range, altrimenti slot libero, altrimenti il meno recente tra quelli esaminati
+    for(int i = 0; i < REGIMAGE_PROBE; i++){
+        regimage_slot *curr = &image->slot[(h + i) % REGIMAGE_SLOTS];
+
+        if(curr->unit == unit && curr->fc == fc && curr->start == start && curr->count == count){
+            slot = curr;
+            break;
+        }
+
+        if(slot == NULL || (slot->count != 0 && (curr->count == 0 || curr->monoUs < slot->monoUs)))
+            slot = curr;
+    }
+
+    // Seqlock: dispari durante la scrittura
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->unit = unit;
+    slot->fc = fc;
+    slot->start = start;
+    slot->count = count;
+    slot->len = len;
+    slot->monoUs = clockUs(CLOCK_MONOTONIC);
+    slot->realUs = clockUs(CLOCK_REALTIME);
+    memcpy(slot->data, data, len);
+
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&writeLock);
+}
@@ -0,0 +1,133 @@
+/**
+ * @file regimage.h
+ * @author Federico Turco ()
+ * @brief Immagine registri in memoria condivisa POSIX (seqlock)
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ * Il gateway pubblica gli ultimi valori letti (FC01..FC04) per unit ID e range.
+ * I processi locali includono solo questo header:
+ * 
+ *     const regimage *img = regimageOpen("/gwModbus");
+ *     uint8_t data[REGIMAGE_DATA];
+ *     uint64_t monoUs;
+ *     int len = regimageRead(img, 1, 0x03, 0, 10, data, sizeof(data), &monoUs);
+ * 
+ * regimageRead non fa syscall: confrontare monoUs con CLOCK_MONOTONIC per la freschezza.
+ */
+
+#ifndef REGIMAGE_H
+#define REGIMAGE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define REGIMAGE_MAGIC      0x4D425247      // "MBRG"
+#define REGIMAGE_VERSION    1
+#define REGIMAGE_SLOTS      512
+#define REGIMAGE_PROBE      8               // Slot esaminati a partire dall'hash
+#define REGIMAGE_DATA       250             // 125 registri o 2000 bit
+
+// Valori di un range letto da uno slave
+typedef struct{
+    uint32_t seq;           // Seqlock: dispari = scrittura in corso
+    uint8_t unit;           // Unit ID lato TCP
+    uint8_t fc;             // Function code di lettura
+    uint16_t start;         // Indirizzo iniziale lato TCP
+    uint16_t count;         // Quantity, 0 = slot libero
+    uint16_t len;           // Byte validi in data (come nella risposta ModBus)
+    uint64_t monoUs;        // CLOCK_MONOTONIC dell'ultimo aggiornamento (us)
+    uint64_t realUs;        // CLOCK_REALTIME dell'ultimo aggiornamento (us)
+    uint8_t data[REGIMAGE_DATA];
+} regimage_slot;
+
+typedef struct{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nSlots;
+    uint32_t slotSize;
+    regimage_slot slot[REGIMAGE_SLOTS];
+} regimage;
+
+static inline uint32_t regimageHash(uint8_t unit, uint8_t fc, uint16_t start, uint16_t count)
+{
+    uint32_t h = ((uint32_t)unit << 24) ^ ((uint32_t)fc << 16) ^ start ^ ((uint32_t)count << 7);
+
+    h ^= h >> 13;
+    h *= 0x5bd1e995;
+    h ^= h >> 15;
+
+    return h % REGIMAGE_SLOTS;
+}
+
+// Mappa il segmento in sola lettura, NULL se assente o di versione diversa
+static inline const regimage *regimageOpen(const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+
+    if(fd == -1)
+        return NULL;
+
+    void *p = mmap(NULL, sizeof(regimage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(p == MAP_FAILED)
+        return NULL;
+
+    const regimage *img = (const regimage *)p;
+
+    if(img->magic != REGIMAGE_MAGIC || img->version != REGIMAGE_VERSION || img->slotSize != sizeof(regimage_slot)){
+        munmap(p, sizeof(regimage));
+        return NULL;
+    }
+
+    return img;
+}
+
+// Copia i valori del range in data, ritorna i byte copiati o -1 se il range non e' pubblicato
+static inline int regimageRead(const regimage *img, uint8_t unit, uint8_t fc, uint16_t start, uint16_t count,
+                               uint8_t *data, uint16_t size, uint64_t *monoUs)
+{
+    uint32_t h = regimageHash(unit, fc, start, count);
+
+    for(int i = 0; i < REGIMAGE_PROBE; i++){
+        const regimage_slot *slot = &img->slot[(h + i) % REGIMAGE_SLOTS];
+        uint32_t seq;
+        int found = 0, len = 0;
+
+        do{
+            seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+            if(seq & 1)
+                continue;
+
+            found = slot->unit == unit && slot->fc == fc && slot->start == start && slot->count == count;
+            len = slot->len < size ? slot->len : size;
+
+            if(found){
+                memcpy(data, slot->data, len);
+
+                if(monoUs)
+                    *monoUs = slot->monoUs;
+            }
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        }while((seq & 1) || seq != __atomic_load_n(&slot->seq, __ATOMIC_RELAXED));
+
+        if(found)
+            return len;
+    }
+
+    return -1;
+}
+
+// Lato gateway (regimage.c)
+int regimageCreate(const char *name);
+void regimagePublish(uint8_t unit, uint8_t fc, uint16_t start, uint16_t count, const uint8_t *data, uint16_t len);
+
+#endif
@@ -0,0 +1,143 @@
+/**
+ * @file rt.c
+ * @author Federico Turco ()
+ * @brief Modalita' real-time dei thread dei bus e statistiche di jitter
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <termios.h>
+
+#include "config.h"
+#include "rt.h"
+
+// Ritardo di risveglio delle attese temporizzate del thread del bus (silenzio inter-frame, turnaround)
+typedef struct{
+    uint64_t samples;
+    uint64_t sumUs;
+    uint64_t minUs;
+    uint64_t maxUs;
+    uint64_t histogram[RT_JITTER_BUCKETS];
+} rt_jitter;
+
+// Una statistica per bus, aggiornata solo dal thread del bus
+static rt_jitter jitter[MAX_RTU_BUS] = { [0 ... MAX_RTU_BUS - 1] = { .minUs = UINT64_MAX } };
+
+// Tocca lo stack in modo che le pagine siano gia' presenti (e bloccate) durante le transazioni.
+// Chiamata da ogni thread dei bus all'avvio
+void rtPrefaultStack(void)
+{
+    volatile uint8_t stack[RT_STACK_PREFAULT];
+
+    for(int i = 0; i < RT_STACK_PREFAULT; i += 4096)
+        stack[i] = 0;
+}
+
+// Blocca la memoria del processo e pre-alloca l'heap. 0 se ok
+int rtSetup(config *config)
+{
+    // Niente restituzione dell'heap al sistema e niente mmap per le allocazioni: nessun page fault successivo
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) == -1){
+        printMillis();
+        printf("ERROR: mlockall failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if(config->verbose){
+        printMillis();
+        printf("Real-time mode: SCHED_FIFO %i, CPU %i, memory locked\n", config->rt.priority, config->rt.cpu);
+    }
+
+    return 0;
+}
+
+// Attributi dei thread dei bus: SCHED_FIFO e CPU dedicata, applicati da pthread_create
+// (che fallisce se la priorita' non e' consentita)
+void rtThreadAttr(config *config, pthread_attr_t *attr)
+{
+    struct sched_param param;
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config->rt.priority;
+
+    pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+    pthread_attr_setschedparam(attr, &param);
+
+    if(config->rt.cpu >= 0){
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(config->rt.cpu, &set);
+        pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+    }
+}
+
+void rtJitterSample(int bus, uint64_t us)
+{
+    rt_jitter *j = &jitter[bus];
+    int bucket = 0;
+
+    while(bucket < RT_JITTER_BUCKETS - 1 && (us >> bucket) != 0)
+        bucket++;
+
+    j->samples++;
+    j->sumUs += us;
+    j->histogram[bucket]++;
+
+    if(us < j->minUs)
+        j->minUs = us;
+
+    if(us > j->maxUs)
+        j->maxUs = us;
+}
+
+void rtJitterDump(FILE *out, config *config)
+{
+    fprintf(out, "\nBus thread wake-up latency (us)\n");
+
+    for(int bus = 0; bus < config->nBus; bus++){
+        rt_jitter *j = &jitter[bus];
+
+        if(config->rtu[bus].device[0] == 0)
+            continue;
+
+        if(j->samples == 0){
+            fprintf(out, "  bus %i: no samples\n", bus + 1);
+            continue;
+        }
+
+        fprintf(out, "  bus %i: samples %llu, min %llu, avg %llu, max %llu\n", bus + 1,
+                (unsigned long long)j->samples, (unsigned long long)j->minUs,
+                (unsigned long long)(j->sumUs / j->samples), (unsigned long long)j->maxUs);
+
+        for(int i = 0; i < RT_JITTER_BUCKETS; i++){
+            if(j->histogram[i] == 0)
+                continue;
+
+            // L'ultimo intervallo raccoglie anche i valori fuori scala
+            if(i == RT_JITTER_BUCKETS - 1)
+                fprintf(out, "    >= %5llu: %llu\n", 1ULL << (i - 1), (unsigned long long)j->histogram[i]);
+            else
+                fprintf(out, "    <  %5llu: %llu\n", 1ULL << i, (unsigned long long)j->histogram[i]);
+        }
+    }
+
+    fflush(out);
+}
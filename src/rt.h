@@ -0,0 +1,34 @@
+/**
+ * @file rt.h
+ * @author Federico Turco ()
+ * @brief Modalita' real-time dei thread dei bus e statistiche di jitter
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#ifndef RT_H
+#define RT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <termios.h>
+
+#include "config.h"
+
+// Stack pre-allocato (e bloccato in RAM) all'avvio di ogni thread dei bus
+#define RT_STACK_PREFAULT   (256 * 1024)
+
+// Intervalli dell'istogramma jitter: < 2^i us
+#define RT_JITTER_BUCKETS   16
+
+int rtSetup(config *config);
+void rtThreadAttr(config *config, pthread_attr_t *attr);
+void rtPrefaultStack(void);
+void rtJitterSample(int bus, uint64_t us);
+void rtJitterDump(FILE *out, config *config);
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * @file serial.c
+ * @author Federico Turco ()
+ * @brief Baudrate arbitrari (termios2) e temporizzazioni della linea RTU
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+// Solo header del kernel: asm/termbits.h e' incompatibile con termios.h della libc
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+
+#include "serial.h"
+
+// Imposta un baudrate qualsiasi con BOTHER, 0 se ok
+int serialSetBaud(int fd, int baud)
+{
+    struct termios2 tio;
+
+    if(ioctl(fd, TCGETS2, &tio) == -1)
+        return -1;
+
+    tio.c_cflag &= ~CBAUD;
+    tio.c_cflag |= BOTHER;
+    tio.c_cflag &= ~(CBAUD << IBSHIFT);
+    tio.c_cflag |= BOTHER << IBSHIFT;
+    tio.c_ispeed = baud;
+    tio.c_ospeed = baud;
+
+    return ioctl(fd, TCSETS2, &tio);
+}
+
+// Baudrate effettivo impostato dal driver, -1 se non disponibile
+int serialGetBaud(int fd)
+{
+    struct termios2 tio;
+
+    if(ioctl(fd, TCGETS2, &tio) == -1)
+        return -1;
+
+    return tio.c_ospeed;
+}
+
+// Attesa fino all'istante us (CLOCK_MONOTONIC)
+void serialWaitUntil(uint64_t us)
+{
+    struct timespec spec;
+
+    spec.tv_sec = us / 1000000;
+    spec.tv_nsec = (us % 1000000) * 1000;
+
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &spec, NULL) == EINTR);
+}
+
+// Attende che l'ultimo bit sia uscito dallo shift register.
+// Senza TIOCSERGETLSR (USB, pty) attende la fine stimata della trasmissione txEndUs
+void serialWaitTxEmpty(int fd, uint64_t txEndUs, uint32_t charUs)
+{
+    unsigned int lsr;
+
+    // tcdrain: buffer del driver svuotato
+    while(ioctl(fd, TCSBRK, 1) == -1 && errno == EINTR);
+
+    if(ioctl(fd, TIOCSERGETLSR, &lsr) == -1){
+        serialWaitUntil(txEndUs);
+        return;
+    }
+
+    while(!(lsr & TIOCSER_TEMT)){
+        struct timespec spec = { 0, charUs * 1000 / 4 };
+
+        while(nanosleep(&spec, &spec) == -1 && errno == EINTR);
+
+        if(ioctl(fd, TIOCSERGETLSR, &lsr) == -1)
+            return;
+    }
+}
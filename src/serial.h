@@ -0,0 +1,22 @@
+/**
+ * @file serial.h
+ * @author Federico Turco ()
+ * @brief Baudrate arbitrari (termios2) e temporizzazioni della linea RTU
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+
+int serialSetBaud(int fd, int baud);
+int serialGetBaud(int fd);
+void serialWaitUntil(uint64_t us);
+void serialWaitTxEmpty(int fd, uint64_t txEndUs, uint32_t charUs);
+
+#endif
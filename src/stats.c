@@ -0,0 +1,31 @@
+/**
+ * @file stats.c
+ * @author Federico Turco ()
+ * @brief Contatori del gateway
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "stats.h"
+
+gw_stats stats;
+
+void statsDump(FILE *out)
+{
+    fprintf(out, "\nStatistics\n");
+    fprintf(out, "  requests:        %llu\n", (unsigned long long)stats.requests);
+    fprintf(out, "  responses:       %llu\n", (unsigned long long)stats.responses);
+    fprintf(out, "  exceptions:      %llu\n", (unsigned long long)stats.exceptions);
+    fprintf(out, "  timeouts:        %llu\n", (unsigned long long)stats.timeouts);
+    fprintf(out, "  crc errors:      %llu\n", (unsigned long long)stats.crcErrors);
+    fprintf(out, "  drop expired:    %llu\n", (unsigned long long)stats.dropExpired);
+    fprintf(out, "  drop orphaned:   %llu\n", (unsigned long long)stats.dropOrphaned);
+    fprintf(out, "  reject busy:     %llu\n", (unsigned long long)stats.rejectBusy);
+    fflush(out);
+}
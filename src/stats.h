@@ -0,0 +1,36 @@
+/**
+ * @file stats.h
+ * @author Federico Turco ()
+ * @brief Contatori del gateway
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct{
+    uint64_t requests;          // Request TCP valide ricevute
+    uint64_t responses;         // Risposte inoltrate al client
+    uint64_t exceptions;        // Eccezioni generate dal gateway
+    uint64_t timeouts;          // Nessuna risposta dallo slave
+    uint64_t crcErrors;         // Risposte RTU con CRC errato
+    uint64_t dropExpired;       // Request scartate: deadline superata prima della transazione RTU
+    uint64_t dropOrphaned;      // Request scartate: client disconnesso prima della transazione RTU
+    uint64_t rejectBusy;        // Request rifiutate con eccezione 0x06: bus saturo
+} gw_stats;
+
+extern gw_stats stats;
+
+// Incremento atomico, i contatori possono essere letti da altri thread
+#define STATS_INC(counter)  __atomic_fetch_add(&stats.counter, 1, __ATOMIC_RELAXED)
+
+void statsDump(FILE *out);
+
+#endif
@@ -0,0 +1,90 @@
+/**
+ * @file trace.c
+ * @author Federico Turco ()
+ * @brief Trace per transazione con timestamp monotonici
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+// Ring statico delle ultime TRACE_RING_SIZE transazioni
+static trace_entry ring[TRACE_RING_SIZE];
+static uint32_t nextId = 0;
+
+uint64_t micros(void)
+{
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+
+    return (uint64_t)spec.tv_sec * 1000000 + (uint64_t)spec.tv_nsec / 1000;
+}
+
+// Trace di una nuova transazione, tenuto dal chiamante (nella transazione) fino a traceCommit
+void traceBegin(trace_entry *tr)
+{
+    memset(tr, 0, sizeof(*tr));
+    tr->t[TRACE_ACCEPT] = micros();
+}
+
+// Registra il punto e ritorna l'istante
+uint64_t traceMark(trace_entry *tr, trace_point point)
+{
+    tr->t[point] = micros();
+
+    return tr->t[point];
+}
+
+// Copia nel ring la transazione conclusa: le transazioni in coda non occupano slot
+void traceCommit(const trace_entry *tr)
+{
+    uint32_t id = __atomic_fetch_add(&nextId, 1, __ATOMIC_RELAXED);
+    trace_entry *slot = &ring[id % TRACE_RING_SIZE];
+
+    *slot = *tr;
+    slot->id = id + 1;
+}
+
+// Differenza in us tra due punti, -1 se uno dei due non e' stato raggiunto
+static long traceDelta(trace_entry *tr, trace_point from, trace_point to)
+{
+    if(tr->t[from] == 0 || tr->t[to] == 0)
+        return -1;
+
+    return (long)(tr->t[to] - tr->t[from]);
+}
+
+void traceDump(FILE *out)
+{
+    uint32_t last = __atomic_load_n(&nextId, __ATOMIC_RELAXED);
+    uint32_t count = last < TRACE_RING_SIZE ? last : TRACE_RING_SIZE;
+
+    fprintf(out, "\nLast %u transactions (us, -1 = not reached)\n", count);
+    fprintf(out, "%8s %4s %3s %3s %8s %8s %8s %8s %8s %8s %8s\n",
+            "id", "unit", "bus", "fc", "tcp_rx", "queue", "ser_tx", "turn", "ser_rx", "tcp_tx", "total");
+
+    for(uint32_t i = last - count; i != last; i++){
+        trace_entry *tr = &ring[i % TRACE_RING_SIZE];
+
+        fprintf(out, "%8u %4u %3u %3u %8li %8li %8li %8li %8li %8li %8li\n",
+                tr->id, tr->unit, tr->bus + 1, tr->fc,
+                traceDelta(tr, TRACE_ACCEPT, TRACE_TCP_RX),
+                traceDelta(tr, TRACE_QUEUE_IN, TRACE_QUEUE_OUT),
+                traceDelta(tr, TRACE_SER_TX_START, TRACE_SER_TX_END),
+                traceDelta(tr, TRACE_SER_TX_END, TRACE_SER_RX_FIRST),
+                traceDelta(tr, TRACE_SER_RX_FIRST, TRACE_SER_RX_LAST),
+                traceDelta(tr, TRACE_SER_RX_LAST, TRACE_TCP_TX),
+                traceDelta(tr, TRACE_ACCEPT, TRACE_TCP_TX));
+    }
+
+    fprintf(out, "\n");
+    fflush(out);
+}
@@ -0,0 +1,49 @@
+/**
+ * @file trace.h
+ * @author Federico Turco ()
+ * @brief Trace per transazione con timestamp monotonici
+ * @version 1.0
+ * @date 2022-02-15
+ * 
+ * @copyright Copyright (c) Turco Federico 2022
+ * 
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Numero di transazioni concluse mantenute nel ring
+#define TRACE_RING_SIZE     64
+
+// Punti di misura di una transazione
+typedef enum{
+    TRACE_ACCEPT = 0,
+    TRACE_TCP_RX,
+    TRACE_QUEUE_IN,
+    TRACE_QUEUE_OUT,
+    TRACE_SER_TX_START,
+    TRACE_SER_TX_END,
+    TRACE_SER_RX_FIRST,
+    TRACE_SER_RX_LAST,
+    TRACE_TCP_TX,
+    TRACE_N_POINTS
+} trace_point;
+
+typedef struct{
+    uint32_t id;
+    uint8_t unit;
+    uint8_t bus;
+    uint8_t fc;
+    uint64_t t[TRACE_N_POINTS];     // us monotonici, 0 = punto non raggiunto
+} trace_entry;
+
+uint64_t micros(void);
+void traceBegin(trace_entry *tr);
+uint64_t traceMark(trace_entry *tr, trace_point point);
+void traceCommit(const trace_entry *tr);
+void traceDump(FILE *out);
+
+#endif
@@ -0,0 +1,197 @@
+/**
+ * @file test_codec.c
+ * @author Federico Turco ()
+ * @brief Test a risposte note del codec ModBus: semantica di mbFcTable, CRC16, conversione TCP <-> RTU
+ * @version 1.0
+ * @date 2022-02-15
+ *
+ * @copyright Copyright (c) Turco Federico 2022
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "../src/crc.h"
+#include "../src/modbus.h"
+
+static int failures = 0;
+
+#define CHECK(cond)     do { if(!(cond)){ printf("FAIL %s:%i: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static void testReadBits(void)
+{
+    // FC01 quantity 2000: 250 bytes di dati -> slave ID, FC, byte count, CRC + 250 = 255
+    const uint8_t max[] = { 0x01, 0x00, 0x00, 0x07, 0xD0 };
+    const uint8_t over[] = { 0x01, 0x00, 0x00, 0x07, 0xD1 };
+    const uint8_t zero[] = { 0x02, 0x00, 0x00, 0x00, 0x00 };
+    const uint8_t nine[] = { 0x02, 0x00, 0x10, 0x00, 0x09 };
+
+    CHECK(mbValidatePdu(max, sizeof(max)) == 0);
+    CHECK(mbResponseLen(max, sizeof(max)) == 255);
+    CHECK(mbValidatePdu(over, sizeof(over)) == MB_EX_ILLEGAL_DATA_VALUE);
+    CHECK(mbValidatePdu(zero, sizeof(zero)) == MB_EX_ILLEGAL_DATA_VALUE);
+    CHECK(mbResponseLen(nine, sizeof(nine)) == 5 + 2);
+}
+
+static void testReadRegisters(void)
+{
+    const uint8_t max[] = { 0x03, 0x00, 0x00, 0x00, 0x7D };
+    const uint8_t over[] = { 0x04, 0x00, 0x00, 0x00, 0x7E };
+    const uint8_t wrap[] = { 0x03, 0xFF, 0xFF, 0x00, 0x02 };
+    const uint8_t last[] = { 0x03, 0xFF, 0xFF, 0x00, 0x01 };
+    const uint8_t shortPdu[] = { 0x03, 0x00, 0x00, 0x00 };
+
+    CHECK(mbValidatePdu(max, sizeof(max)) == 0);
+    CHECK(mbResponseLen(max, sizeof(max)) == 255);
+    CHECK(mbValidatePdu(over, sizeof(over)) == MB_EX_ILLEGAL_DATA_VALUE);
+    CHECK(mbValidatePdu(wrap, sizeof(wrap)) == MB_EX_ILLEGAL_DATA_ADDRESS);
+    CHECK(mbValidatePdu(last, sizeof(last)) == 0);
+    CHECK(mbValidatePdu(shortPdu, sizeof(shortPdu)) == MB_EX_ILLEGAL_DATA_VALUE);
+    CHECK(mbResponseLen(shortPdu, sizeof(shortPdu)) == -1);
+}
+
+static void testWriteSingle(void)
+{
+    // FC05: solo 0xFF00 (ON) e 0x0000 (OFF)
+    const uint8_t on[] = { 0x05, 0x00, 0xAC, 0xFF, 0x00 };
+    const uint8_t off[] = { 0x05, 0x00, 0xAC, 0x00, 0x00 };
+    const uint8_t bad[] = { 0x05, 0x00, 0xAC, 0x12, 0x34 };
+    const uint8_t reg[] = { 0x06, 0x00, 0x01, 0x12, 0x34 };
+
+    CHECK(mbValidatePdu(on, sizeof(on)) == 0);
+    CHECK(mbValidatePdu(off, sizeof(off)) == 0);
+    CHECK(mbValidatePdu(bad, sizeof(bad)) == MB_EX_ILLEGAL_DATA_VALUE);
+    CHECK(mbResponseLen(on, sizeof(on)) == 8);
+
+    // FC06: qualsiasi valore
+    CHECK(mbValidatePdu(reg, sizeof(reg)) == 0);
+    CHECK(mbResponseLen(reg, sizeof(reg)) == 8);
+}
+
+static void testWriteMultiple(void)
+{
+    // FC0F: 10 coil -> byte count 2
+    const uint8_t coils[] = { 0x0F, 0x00, 0x13, 0x00, 0x0A, 0x02, 0xCD, 0x01 };
+    const uint8_t coilsCount[] = { 0x0F, 0x00, 0x13, 0x00, 0x0A, 0x03, 0xCD, 0x01, 0x00 };
+    const uint8_t coilsShort[] = { 0x0F, 0x00, 0x13, 0x00, 0x0A, 0x02, 0xCD };
+
+    CHECK(mbValidatePdu(coils, sizeof(coils)) == 0);
+    CHECK(mbResponseLen(coils, sizeof(coils)) == 8);
+    CHECK(mbValidatePdu(coilsCount, sizeof(coilsCount)) == MB_EX_ILLEGAL_DATA_VALUE);
+    CHECK(mbValidatePdu(coilsShort, sizeof(coilsShort)) == MB_EX_ILLEGAL_DATA_VALUE);
+
+    // FC10: 2 registri -> byte count 4
+    const uint8_t regs[] = { 0x10, 0x00, 0x01, 0x00, 0x02, 0x04, 0x00, 0x0A, 0x01, 0x02 };
+    const uint8_t regsCount[] = { 0x10, 0x00, 0x01, 0x00, 0x02, 0x03, 0x00, 0x0A, 0x01 };
+    const uint8_t regsLong[] = { 0x10, 0x00, 0x01, 0x00, 0x02, 0x04, 0x00, 0x0A, 0x01, 0x02, 0xFF };
+    const uint8_t regsOver[] = { 0x10, 0x00, 0x01, 0x00, 0x7C, 0xF8 };
+
+    CHECK(mbValidatePdu(regs, sizeof(regs)) == 0);
+    CHECK(mbResponseLen(regs, sizeof(regs)) == 8);
+    CHECK(mbValidatePdu(regsCount, sizeof(regsCount)) == MB_EX_ILLEGAL_DATA_VALUE);
+    CHECK(mbValidatePdu(regsLong, sizeof(regsLong)) == MB_EX_ILLEGAL_DATA_VALUE);
+    CHECK(mbValidatePdu(regsOver, sizeof(regsOver)) == MB_EX_ILLEGAL_DATA_VALUE);
+}
+
+static void testDiagnostics(void)
+{
+    // FC08: la risposta e' l'eco della request, slave ID + PDU + CRC
+    const uint8_t echo[] = { 0x08, 0x00, 0x00, 0x12, 0x34 };
+    const uint8_t echoLong[] = { 0x08, 0x00, 0x00, 0x12, 0x34, 0x56, 0x78 };
+
+    CHECK(mbValidatePdu(echo, sizeof(echo)) == 0);
+    CHECK(mbResponseLen(echo, sizeof(echo)) == 8);
+    CHECK(mbResponseLen(echoLong, sizeof(echoLong)) == 10);
+}
+
+static void testUnsupported(void)
+{
+    const uint8_t mei[] = { 0x2B, 0x0E, 0x01, 0x00, 0x00 };
+
+    CHECK(mbValidatePdu(mei, sizeof(mei)) == MB_EX_ILLEGAL_FUNCTION);
+    CHECK(mbResponseLen(mei, sizeof(mei)) == -1);
+}
+
+static void testCrc(void)
+{
+    // Read Holding Registers slave 1, 10 registri: CRC C5 CD
+    uint8_t frame[8] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A };
+
+    CHECK(addCrc16(frame, 6) == 8);
+    CHECK(frame[6] == 0xC5 && frame[7] == 0xCD);
+    CHECK(checkCrc16(frame, 8) == 0);
+
+    frame[3] ^= 0x01;
+    CHECK(checkCrc16(frame, 8) != 0);
+}
+
+static void testFrames(void)
+{
+    const uint8_t request[] = { 0x12, 0x34, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A };
+    const uint8_t protocol[] = { 0x12, 0x34, 0x00, 0x01, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A };
+    const uint8_t rtuRequest[] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0xC5, 0xCD };
+    const uint8_t tcpResponse[] = { 0x12, 0x34, 0x00, 0x00, 0x00, 0x07, 0x01, 0x03, 0x04, 0x00, 0x01, 0x00, 0x02 };
+    const uint8_t exception[] = { 0x12, 0x34, 0x00, 0x00, 0x00, 0x03, 0x01, 0x83, 0x06 };
+    uint8_t rtu[MB_RTU_ADU_MAX];
+    uint8_t tcp[MB_TCP_ADU_MAX];
+    mbap_header mbap;
+
+    CHECK(mbParseMbap(request, sizeof(request), &mbap) == (ssize_t)sizeof(request));
+    CHECK(mbap.transactionId == 0x1234 && mbap.length == 6 && mbap.unitId == 0x01);
+    CHECK(mbParseMbap(protocol, sizeof(protocol), &mbap) == -1);
+    CHECK(mbParseMbap(request, sizeof(request) - 1, &mbap) == -1);
+
+    mbParseMbap(request, sizeof(request), &mbap);
+
+    // TCP -> RTU
+    CHECK(mbBuildRtu(request, sizeof(request), rtu, sizeof(rtu)) == (ssize_t)sizeof(rtuRequest));
+    CHECK(memcmp(rtu, rtuRequest, sizeof(rtuRequest)) == 0);
+
+    // RTU -> TCP: transaction ID della request, length = unit ID + PDU
+    memcpy(rtu, (const uint8_t[]){ 0x01, 0x03, 0x04, 0x00, 0x01, 0x00, 0x02 }, 7);
+    addCrc16(rtu, 7);
+
+    CHECK(mbBuildTcp(&mbap, rtu, 9, tcp, sizeof(tcp)) == (ssize_t)sizeof(tcpResponse));
+    CHECK(memcmp(tcp, tcpResponse, sizeof(tcpResponse)) == 0);
+    CHECK(mbBuildTcp(&mbap, rtu, 3, tcp, sizeof(tcp)) == -1);
+
+    CHECK(mbBuildException(&mbap, 0x03, MB_EX_SLAVE_DEVICE_BUSY, tcp, sizeof(tcp)) == MB_TCP_EXCEPTION_LEN);
+    CHECK(memcmp(tcp, exception, sizeof(exception)) == 0);
+}
+
+static void testRtuException(void)
+{
+    // Dopo slave ID e FC | 0x80 la risposta e' lunga 5 bytes, non si attende il timeout
+    const uint8_t exception[] = { 0x01, 0x83 };
+    const uint8_t normal[] = { 0x01, 0x03 };
+
+    CHECK(mbRtuExpectedLen(exception, 2, 255) == MB_RTU_EXCEPTION_LEN);
+    CHECK(mbRtuExpectedLen(exception, 1, 255) == 255);
+    CHECK(mbRtuExpectedLen(normal, 2, 255) == 255);
+}
+
+int main(void)
+{
+    testReadBits();
+    testReadRegisters();
+    testWriteSingle();
+    testWriteMultiple();
+    testDiagnostics();
+    testUnsupported();
+    testCrc();
+    testFrames();
+    testRtuException();
+
+    if(failures){
+        printf("%i checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    printf("All codec checks passed\n");
+
+    return EXIT_SUCCESS;
+}